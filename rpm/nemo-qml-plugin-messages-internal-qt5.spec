@@ -7,7 +7,9 @@ License:    BSD
 URL:        https://github.com/sailfishos/nemo-qml-plugin-messages
 Source0:    %{name}-%{version}.tar.bz2
 BuildRequires:  pkgconfig(Qt5Core)
+BuildRequires:  pkgconfig(Qt5Concurrent)
 BuildRequires:  pkgconfig(Qt5Qml)
+BuildRequires:  pkgconfig(Qt5Quick)
 BuildRequires:  pkgconfig(Qt5Contacts)
 BuildRequires:  pkgconfig(Qt5Test)
 BuildRequires:  pkgconfig(TelepathyQt5)
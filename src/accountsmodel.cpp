@@ -40,15 +40,31 @@
 
 Q_DECLARE_METATYPE(Tp::AccountPtr)
 
+namespace {
+
+Tp::WeakPtr<Tp::AccountManager> sharedManager;
+
+}
+
 AccountsModel::AccountsModel(QObject *parent)
     : QAbstractListModel(parent), mReady(false)
 {
-    mAccountManager = Tp::AccountManager::create(Tp::AccountFactory::create(QDBusConnection::sessionBus(),
-                Tp::Account::FeatureCore));
+    mAccountManager = sharedAccountManager();
     connect(mAccountManager->becomeReady(), SIGNAL(finished(Tp::PendingOperation*)), SLOT(accountManagerReady(Tp::PendingOperation*)));
     connect(mAccountManager.data(), SIGNAL(newAccount(Tp::AccountPtr)), SLOT(newAccount(Tp::AccountPtr)));
 }
 
+Tp::AccountManagerPtr AccountsModel::sharedAccountManager()
+{
+    Tp::AccountManagerPtr manager(sharedManager);
+    if (manager.isNull()) {
+        manager = Tp::AccountManager::create(Tp::AccountFactory::create(QDBusConnection::sessionBus(),
+                    Tp::Account::FeatureCore));
+        sharedManager = Tp::WeakPtr<Tp::AccountManager>(manager);
+    }
+    return manager;
+}
+
 QHash<int,QByteArray> AccountsModel::roleNames() const
 {
     QHash<int,QByteArray> roles;
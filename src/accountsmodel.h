@@ -57,6 +57,10 @@ public:
 
     AccountsModel(QObject *parent = 0);
 
+    /* The account manager shared within the process, whose accounts are ready with their core
+     * features; it exists for as long as any user holds a reference to it */
+    static Tp::AccountManagerPtr sharedAccountManager();
+
     virtual int rowCount(const QModelIndex &parent = QModelIndex()) const;
     virtual QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
     virtual QHash<int,QByteArray> roleNames() const;
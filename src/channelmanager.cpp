@@ -30,10 +30,14 @@
 
 #include "channelmanager.h"
 #include "conversationchannel.h"
+#include "accountsmodel.h"
 #include <QPointer>
 
 #include <CommHistory/recipient.h>
 
+#include <QDBusConnection>
+#include <QDBusMetaType>
+
 #include <TelepathyQt/ChannelClassSpec>
 #include <TelepathyQt/ReceivedMessage>
 #include <TelepathyQt/TextChannel>
@@ -64,6 +68,14 @@ public:
 ChannelManager::ChannelManager(QObject *parent)
     : QObject(parent)
 {
+    // Pending events are retired as soon as commhistoryd reports that they are being sent
+    qDBusRegisterMetaType<QList<CommHistory::Event> >();
+    QDBusConnection::sessionBus().connect(QString(), QString(), QLatin1String("com.nokia.commhistory"), QLatin1String("eventsUpdated"),
+                                          this, SLOT(eventsUpdated(QList<CommHistory::Event>)));
+
+    // Readying the accounts now saves the first conversation from waiting for them
+    accountManager = AccountsModel::sharedAccountManager();
+    accountManager->becomeReady();
 }
 
 ChannelManager::~ChannelManager()
@@ -105,20 +117,96 @@ ConversationChannel *ChannelManager::getConversation(const QString &localUid, co
 
     ConversationChannel *channel = new ConversationChannel(localUid, remoteUid, this);
     connect(channel, SIGNAL(destroyed(QObject*)), SLOT(channelDestroyed(QObject*)));
+    connect(channel, SIGNAL(pendingEventAdded(int)), SLOT(pendingEventAdded(int)));
+    connect(channel, SIGNAL(pendingEventRemoved(int)), SLOT(pendingEventRemoved(int)));
     channels.append(channel);
 
     return channel;
 }
 
-bool ChannelManager::isPendingEvent(int eventId)
+ConversationChannel *ChannelManager::prepareConversation(const QString &localUid, const QString &remoteUid)
 {
-    foreach (ConversationChannel *channel, channels) {
-        if (channel->eventIsPending(eventId)) {
-            return true;
-        }
+    ConversationChannel *channel = getConversation(localUid, remoteUid);
+    // Channels that have been requested already, or have failed, are not prepared again
+    if (channel->state() != ConversationChannel::Null)
+        return channel;
+    if (preparingChannels.contains(channel) || preparationQueue.contains(channel))
+        return channel;
+
+    if (preparingChannels.count() < MaximumPreparing)
+        startPreparing(channel);
+    else
+        preparationQueue.append(channel);
+
+    return channel;
+}
+
+void ChannelManager::startPreparing(ConversationChannel *channel)
+{
+    preparingChannels.append(channel);
+    connect(channel, SIGNAL(stateChanged(int)), SLOT(preparingStateChanged()));
+    channel->ensureChannel();
+}
+
+void ChannelManager::preparingStateChanged()
+{
+    ConversationChannel *channel = qobject_cast<ConversationChannel*>(sender());
+    if (!channel)
+        return;
+
+    // Preparation has finished once the channel is ready, or has failed
+    const ConversationChannel::State state = channel->state();
+    if (state == ConversationChannel::Ready || state == ConversationChannel::Error || state == ConversationChannel::Null)
+        finishPreparing(channel);
+}
+
+void ChannelManager::finishPreparing(ConversationChannel *channel)
+{
+    disconnect(channel, SIGNAL(stateChanged(int)), this, SLOT(preparingStateChanged()));
+    preparationQueue.removeOne(channel);
+    if (!preparingChannels.removeOne(channel))
+        return;
+
+    while (!preparationQueue.isEmpty() && preparingChannels.count() < MaximumPreparing) {
+        ConversationChannel *next = preparationQueue.takeFirst();
+        // Channels requested for sending in the meantime don't need to be prepared
+        if (next->state() == ConversationChannel::Null)
+            startPreparing(next);
     }
+}
+
+bool ChannelManager::isPendingEvent(int eventId)
+{
+    return pendingEvents.contains(eventId);
+}
+
+void ChannelManager::pendingEventAdded(int eventId)
+{
+    ++pendingEvents[eventId];
+}
 
-    return false;
+void ChannelManager::pendingEventRemoved(int eventId)
+{
+    QHash<int, int>::iterator it = pendingEvents.find(eventId);
+    if (it != pendingEvents.end() && --(*it) == 0)
+        pendingEvents.erase(it);
+}
+
+void ChannelManager::eventsUpdated(const QList<CommHistory::Event> &events)
+{
+    foreach (const CommHistory::Event &event, events) {
+        if (event.status() != CommHistory::Event::SendingStatus
+                && event.status() != CommHistory::Event::SentStatus
+                && event.status() != CommHistory::Event::DeliveredStatus)
+            continue;
+
+        // Most updates are for events that are not pending in any channel
+        if (!pendingEvents.contains(event.id()))
+            continue;
+
+        foreach (ConversationChannel *channel, channels)
+            channel->eventStatusReported(event.id());
+    }
 }
 
 void ChannelManager::channelDestroyed(QObject *obj)
@@ -126,6 +214,7 @@ void ChannelManager::channelDestroyed(QObject *obj)
     if (ConversationChannel *channel = static_cast<ConversationChannel*>(obj)) {
         channel->channelDestroyed();
         channels.removeOne(channel);
+        finishPreparing(channel);
     }
 }
 
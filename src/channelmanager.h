@@ -31,12 +31,15 @@
 #ifndef CLIENTHANDLER_H
 #define CLIENTHANDLER_H
 
+#include <QHash>
 #include <QObject>
 #include "conversationchannel.h"
 
 #include <TelepathyQt/AbstractClient>
 #include <TelepathyQt/ClientRegistrar>
 
+#include <CommHistory/event.h>
+
 class GroupManager;
 
 class ChannelManager : public QObject
@@ -59,17 +62,37 @@ public:
     Q_INVOKABLE ConversationChannel *getConversation(const QString &localUid, const QString &remoteUid);
     Q_INVOKABLE bool isPendingEvent(int eventId);
 
+    /* Establishes the channel for a conversation in the background, so that the first message
+     * sent need not wait for it; this is a hint, and only a few channels are prepared at once */
+    Q_INVOKABLE ConversationChannel *prepareConversation(const QString &localUid, const QString &remoteUid);
+
 signals:
     void handlerNameChanged();
 
 private slots:
     void channelDestroyed(QObject *obj);
+    void pendingEventAdded(int eventId);
+    void pendingEventRemoved(int eventId);
+    void eventsUpdated(const QList<CommHistory::Event> &events);
+    void preparingStateChanged();
 
 private:
     QString m_handlerName;
     Tp::ClientRegistrarPtr registrar;
     Tp::AbstractClientPtr handler;
+    // Held so that the accounts remain ready for every conversation
+    Tp::AccountManagerPtr accountManager;
     QList<ConversationChannel*> channels;
+    // The number of channels in which each event is pending
+    QHash<int, int> pendingEvents;
+
+    // Channels being prepared, and those waiting for one of the preparations to finish
+    enum { MaximumPreparing = 2 };
+    QList<ConversationChannel*> preparingChannels;
+    QList<ConversationChannel*> preparationQueue;
+
+    void startPreparing(ConversationChannel *channel);
+    void finishPreparing(ConversationChannel *channel);
 };
 
 #endif
@@ -30,7 +30,7 @@
  */
 
 #include "conversationchannel.h"
-#include "channelmanager.h"
+#include "accountsmodel.h"
 
 #include <TelepathyQt/ChannelRequest>
 #include <TelepathyQt/TextChannel>
@@ -39,22 +39,57 @@
 #include <TelepathyQt/Contact>
 #include <TelepathyQt/Account>
 
+#include <QCoreApplication>
+#include <QDateTime>
+
+#include <random>
+
+namespace {
+
+// Returns a random delay of between half and all of the given delay
+int jitteredDelay(int delay)
+{
+    /* Our own generator leaves the application's qrand() sequence undisturbed; without a seed,
+     * every instance of the application would choose the same delays */
+    static std::minstd_rand generator(std::minstd_rand::result_type(
+            QDateTime::currentMSecsSinceEpoch() ^ QCoreApplication::applicationPid()));
+
+    std::uniform_int_distribution<int> distribution(delay / 2, delay);
+    return distribution(generator);
+}
+
+}
+
 ConversationChannel::ConversationChannel(const QString &localUid, const QString &remoteUid, QObject *parent)
-    : QObject(parent), mPendingRequest(0), mState(Null), mLocalUid(localUid), mRemoteUid(remoteUid), mSequence(0)
+    : QObject(parent), mPendingRequest(0), mAccountPending(false), mState(Null), mLocalUid(localUid), mRemoteUid(remoteUid), mMaximumInFlight(DefaultMaximumInFlight), mSequence(0), mRetirementSlot(0), mRetirementGeneration(0), mRetryAttempts(0)
 {
 }
 
 ConversationChannel::~ConversationChannel()
 {
+    // Our events can no longer be pending
+    const QList<int> pendingEvents(mPendingEvents.keys());
+    mPendingEvents.clear();
+    foreach (int eventId, pendingEvents)
+        emit pendingEventRemoved(eventId);
 }
 
 void ConversationChannel::ensureChannel()
 {
-    if (!mChannels.isEmpty() || mPendingRequest || !mRequest.isNull())
+    if (!mChannels.isEmpty() || mPendingRequest || !mRequest.isNull() || mAccountPending)
         return;
 
     if (!mAccount) {
-        mAccount = Tp::Account::create(TP_QT_ACCOUNT_MANAGER_BUS_NAME, mLocalUid);
+        if (!mAccountManager)
+            mAccountManager = AccountsModel::sharedAccountManager();
+        if (!mAccountManager->isReady()) {
+            // The accounts are made ready along with the manager, once for all conversations
+            mAccountPending = true;
+            connect(mAccountManager->becomeReady(), SIGNAL(finished(Tp::PendingOperation*)),
+                    SLOT(accountManagerReady(Tp::PendingOperation*)));
+            return;
+        }
+        mAccount = mAccountManager->accountForObjectPath(mLocalUid);
     }
     if (!mAccount) {
         qWarning() << "ConversationChannel::ensureChannel no account for" << mLocalUid;
@@ -65,6 +100,7 @@ void ConversationChannel::ensureChannel()
     if (mAccount->isReady()) {
         accountReadyForChannel(0);
     } else {
+        mAccountPending = true;
         connect(mAccount->becomeReady(), SIGNAL(finished(Tp::PendingOperation*)),
                 SLOT(accountReadyForChannel(Tp::PendingOperation*)));
     }
@@ -72,23 +108,26 @@ void ConversationChannel::ensureChannel()
 
 bool ConversationChannel::eventIsPending(int eventId) const
 {
-    QList<QPair<Tp::MessagePartList, int> >::const_iterator mit = mPendingMessages.constBegin(), mend = mPendingMessages.constEnd();
-    for ( ; mit != mend; ++mit) {
-        if ((*mit).second == eventId) {
-            return true;
-        }
-    }
-    QList<QPair<Tp::PendingOperation *, int> >::const_iterator sit = mPendingSends.begin(), send = mPendingSends.end();
-    for ( ; sit != send; ++sit) {
-        if ((*sit).second == eventId) {
-            return true;
-        }
+    return mPendingEvents.contains(eventId);
+}
+
+void ConversationChannel::accountManagerReady(Tp::PendingOperation *op)
+{
+    mAccountPending = false;
+
+    if (op->isError()) {
+        qWarning() << "No account manager for" << mLocalUid << op->errorName() << op->errorMessage();
+        setState(Error);
+        return;
     }
-    return false;
+
+    ensureChannel();
 }
 
 void ConversationChannel::accountReadyForChannel(Tp::PendingOperation *op)
 {
+    mAccountPending = false;
+
     if (op && op->isError()) {
         qWarning() << "No account for" << mLocalUid;
         setState(Error);
@@ -222,15 +261,13 @@ void ConversationChannel::channelReady()
     }
 
     setState(Ready);
+    mRetryAttempts = 0;
 
     if (!mPendingMessages.isEmpty()) {
-        qDebug() << Q_FUNC_INFO << "Sending" << mPendingMessages.size() << "buffered messages to:" << mRemoteUid;
-        QList<QPair<Tp::MessagePartList, int> >::const_iterator it = mPendingMessages.constBegin(), end = mPendingMessages.constEnd();
-        for ( ; it != end; ++it)
-            sendMessage((*it).first, (*it).second, true);
-
-        // We haven't changed the pending set here, as all buffered messages are now pending send operations
-        mPendingMessages.clear();
+        qDebug() << Q_FUNC_INFO << "Sending" << mPendingMessages.size() << "buffered messages to:" << mRemoteUid
+                 << "queued for" << (QDateTime::currentMSecsSinceEpoch() - mPendingMessages.first().queuedTime) << "ms";
+        // Only as many as the send window allows are sent now; the rest follow as sends finish
+        sendQueuedMessages();
     }
 
     // Blindly acknowledge all messages, assuming commhistory handled them
@@ -247,14 +284,14 @@ void ConversationChannel::channelDestroyed()
 
 void ConversationChannel::setState(State newState)
 {
-    if (mState == newState)
-        return;
-
-    mState = newState;
-    emit stateChanged(newState);
+    if (mState != newState) {
+        mState = newState;
+        emit stateChanged(newState);
+    }
 
-    if (mState == Error && !mPendingMessages.isEmpty()) {
-        reportPendingFailed();
+    // The account or channel request may fail again while already in the error state
+    if (newState == Error && !mPendingMessages.isEmpty()) {
+        retryPendingMessages();
     }
 }
 
@@ -271,12 +308,66 @@ void ConversationChannel::messageReceived(const Tp::ReceivedMessage &message)
 }
 
 void ConversationChannel::sendMessage(const QString &text, int eventId)
+{
+    if (eventId < 0)
+        qWarning() << "No event Id in message!";
+
+    Tp::TextChannelPtr textChannel(readyChannel());
+    if (textChannel.isNull() || sendWindowFull() || !mPendingMessages.isEmpty()) {
+        if (textChannel.isNull()) {
+            Q_ASSERT(state() != Ready);
+            qDebug() << Q_FUNC_INFO << "Buffering message until channel is ready for:" << mRemoteUid;
+        } else {
+            qDebug() << Q_FUNC_INFO << "Queueing message behind" << mPendingSends.count() << "sends in flight to:" << mRemoteUid;
+        }
+        const PendingMessage message = { text, eventId, QDateTime::currentMSecsSinceEpoch() };
+        mPendingMessages.enqueue(message);
+        addPendingEvent(eventId);
+        emit queuedCountChanged();
+        if (textChannel.isNull() && mPendingMessages.count() == 1) {
+            ensureChannel();
+        }
+        reportPendingSetChanged();
+        return;
+    }
+
+    addPendingEvent(eventId);
+    transmitMessage(textChannel, text, eventId);
+    emit inFlightCountChanged();
+    reportPendingSetChanged();
+}
+
+void ConversationChannel::setMaximumInFlight(int maximum)
+{
+    maximum = qMax(maximum, 0);
+    if (mMaximumInFlight == maximum)
+        return;
+
+    mMaximumInFlight = maximum;
+    emit maximumInFlightChanged();
+
+    // A wider window may admit queued messages
+    sendQueuedMessages();
+}
+
+Tp::TextChannelPtr ConversationChannel::readyChannel() const
+{
+    Tp::TextChannelPtr textChannel(mChannels.isEmpty() ? Tp::TextChannelPtr() : mChannels.first());
+    if (textChannel.isNull() || !textChannel->isReady())
+        return Tp::TextChannelPtr();
+    return textChannel;
+}
+
+bool ConversationChannel::sendWindowFull() const
+{
+    return mMaximumInFlight > 0 && mPendingSends.count() >= mMaximumInFlight;
+}
+
+void ConversationChannel::transmitMessage(const Tp::TextChannelPtr &textChannel, const QString &text, int eventId)
 {
     Tp::MessagePart header;
     if (eventId >= 0)
         header.insert("x-commhistory-event-id", QDBusVariant(eventId));
-    else
-        qWarning() << "No event Id in message!";
 
     Tp::MessagePart body;
     body.insert("content-type", QDBusVariant(QLatin1String("text/plain")));
@@ -285,32 +376,25 @@ void ConversationChannel::sendMessage(const QString &text, int eventId)
     Tp::MessagePartList parts;
     parts << header << body;
 
-    sendMessage(parts, eventId, false);
+    Tp::PendingSendMessage *msg = textChannel->send(parts);
+    mPendingSends.insert(msg, eventId);
+    connect(msg, SIGNAL(finished(Tp::PendingOperation*)), SLOT(sendingFinished(Tp::PendingOperation*)));
 }
 
-void ConversationChannel::sendMessage(const Tp::MessagePartList &parts, int eventId, bool alreadyPending)
+void ConversationChannel::sendQueuedMessages()
 {
-    Tp::TextChannelPtr textChannel(mChannels.isEmpty() ? Tp::TextChannelPtr() : mChannels.first());
-    if (textChannel.isNull() || !textChannel->isReady()) {
-        Q_ASSERT(state() != Ready);
-        qDebug() << Q_FUNC_INFO << "Buffering message until channel is ready for:" << mRemoteUid;
-        mPendingMessages.append(qMakePair(parts, eventId));
-        if (mPendingMessages.count() == 1) {
-            ensureChannel();
-        }
-        reportPendingSetChanged();
+    Tp::TextChannelPtr textChannel(readyChannel());
+    if (textChannel.isNull() || mPendingMessages.isEmpty() || sendWindowFull())
         return;
-    }
 
-    Tp::PendingSendMessage *msg = textChannel->send(parts);
-    mPendingSends.append(qMakePair(msg, eventId));
-    connect(msg, SIGNAL(finished(Tp::PendingOperation*)), SLOT(sendingFinished(Tp::PendingOperation*)));
+    // Queued messages are already in the pending set, so moving them to the send window doesn't change it
+    do {
+        const PendingMessage message(mPendingMessages.dequeue());
+        transmitMessage(textChannel, message.text, message.eventId);
+    } while (!mPendingMessages.isEmpty() && !sendWindowFull());
 
-    if (!alreadyPending) {
-        // If alreadyPending is false, this message was not previously buffered, so
-        // we have now added it to the pending set
-        reportPendingSetChanged();
-    }
+    emit queuedCountChanged();
+    emit inFlightCountChanged();
 }
 
 void ConversationChannel::sendingFinished(Tp::PendingOperation *op)
@@ -321,24 +405,33 @@ void ConversationChannel::sendingFinished(Tp::PendingOperation *op)
     const bool sendFailed(op->isError());
 
     int eventId = -1;
-    QList<QPair<Tp::PendingOperation *, int> >::iterator it = mPendingSends.begin(), end = mPendingSends.end();
-    for ( ; it != end; ++it) {
-        if ((*it).first == op) {
-            eventId = (*it).second;
-
-            if (sendFailed) {
-                // We're about to report that this event is no longer pending
-                mPendingSends.erase(it);
-            } else if (eventId != -1) {
-                // Don't remove this event from the pending set - it will now be reported as
-                // Sending/Sent by commhistoryd, at which point being part of the pending set
-                // no longer has any relevance.  These events are asynchronous, so don't remove
-                // the item from the pending set until after the status change gets a chance to occur
-                mTimer.stop();
-                mSentEvents.append(eventId);
-                mTimer.start(1000, this);
+    QHash<Tp::PendingOperation *, int>::iterator it = mPendingSends.find(op);
+    const bool inFlight(it != mPendingSends.end());
+    if (inFlight) {
+        eventId = *it;
+        mPendingSends.erase(it);
+        emit inFlightCountChanged();
+
+        if (sendFailed || eventId == -1) {
+            // We're about to report that this event is no longer pending
+            removePendingEvent(eventId);
+        } else {
+            // Don't remove this event from the pending set - it will now be reported as
+            // Sending/Sent by commhistoryd, at which point being part of the pending set
+            // no longer has any relevance.  These events are asynchronous, so don't remove
+            // the item from the pending set until the status change is reported, or else
+            // until its deadline has passed
+            QHash<int, SentEvent>::iterator sent = mSentEvents.find(eventId);
+            if (sent == mSentEvents.end()) {
+                const SentEvent event = { 0, ++mRetirementGeneration };
+                sent = mSentEvents.insert(eventId, event);
             }
-            break;
+            ++sent->count;
+
+            const RetirementDeadlineEntry deadline = { eventId, sent->generation };
+            mRetirementWheel[(mRetirementSlot + RetirementDeadline) % RetirementSlotCount].append(deadline);
+            if (!mTimer.isActive())
+                mTimer.start(RetirementInterval, this);
         }
     }
 
@@ -347,17 +440,24 @@ void ConversationChannel::sendingFinished(Tp::PendingOperation *op)
         Tp::Message msg = static_cast<Tp::PendingSendMessage*>(op)->message();
         eventId = parseEventId(msg.parts());
     }
-    if (eventId == -1)
-        return;
 
-    if (sendFailed) {
-        emit sendingFailed(eventId, this);
+    if (eventId != -1) {
+        if (sendFailed) {
+            emit sendingFailed(eventId, this);
 
-        // Sending failed - commhistoryd does not update the message in this case, so
-        // we should report that it is no longer pending
-        reportPendingSetChanged();
-    } else if (op->isValid()) {
-        emit sendingSucceeded(eventId, this);
+            // Sending failed - commhistoryd does not update the message in this case, so
+            // we should report that it is no longer pending
+            reportPendingSetChanged();
+        } else if (op->isValid()) {
+            emit sendingSucceeded(eventId, this);
+        }
+    }
+
+    if (inFlight) {
+        // This send's place in the window can be taken by the next queued message
+        sendQueuedMessages();
+        if (mPendingMessages.isEmpty() && mPendingSends.isEmpty())
+            emit queueDrained();
     }
 }
 
@@ -385,49 +485,135 @@ void ConversationChannel::channelInvalidated(Tp::DBusProxy *proxy,
     }
 
     qDebug() << "Channel invalidated:" << textChannel->objectPath() << errorName << errorMessage;
-    reportPendingFailed();
 
     setState(Null);
+    retryPendingMessages();
+}
+
+void ConversationChannel::retryPendingMessages()
+{
+    if (mPendingMessages.isEmpty() || mRetryTimer.isActive())
+        return;
+
+    int delay = qMin(RetryInitialDelay << qMin(mRetryAttempts, 16), int(RetryMaximumDelay));
+    // Conversations that failed together should not all retry together
+    delay = jitteredDelay(delay);
+
+    const qint64 deadline = mPendingMessages.first().queuedTime + RetryDeadline;
+    if (mRetryAttempts >= RetryMaximumAttempts || QDateTime::currentMSecsSinceEpoch() + delay > deadline) {
+        qDebug() << Q_FUNC_INFO << "Giving up on channel for:" << mRemoteUid << "after" << mRetryAttempts << "attempts";
+        reportPendingFailed();
+        return;
+    }
+
+    ++mRetryAttempts;
+    qDebug() << Q_FUNC_INFO << "Requesting channel again for:" << mRemoteUid << "in" << delay << "ms";
+    mRetryTimer.start(delay, this);
 }
 
 void ConversationChannel::reportPendingFailed()
 {
+    mRetryTimer.stop();
+    mRetryAttempts = 0;
+
     if (!mPendingMessages.isEmpty()) {
         qDebug() << Q_FUNC_INFO << "Failed sending" << mPendingMessages.size() << "buffered messages to:" << mRemoteUid;
-        QList<QPair<Tp::MessagePartList, int> > failed = mPendingMessages;
-        mPendingMessages.clear();
+        QQueue<PendingMessage> failed;
+        failed.swap(mPendingMessages);
 
-        QList<QPair<Tp::MessagePartList, int> >::const_iterator it = failed.constBegin(), end = failed.constEnd();
+        QQueue<PendingMessage>::const_iterator it = failed.constBegin(), end = failed.constEnd();
         for ( ; it != end; ++it)
-            emit sendingFailed((*it).second, this);
+            removePendingEvent((*it).eventId);
+        for (it = failed.constBegin(); it != end; ++it)
+            emit sendingFailed((*it).eventId, this);
 
+        emit queuedCountChanged();
         reportPendingSetChanged();
+        if (mPendingMessages.isEmpty() && mPendingSends.isEmpty())
+            emit queueDrained();
     }
 }
 
 void ConversationChannel::reportPendingSetChanged()
 {
+    // The sequence changes at once, but changes made in the same pass of the event loop are
+    // notified together
+    if (mSequenceTimer.isActive())
+        return;
+
     ++mSequence;
-    emit sequenceChanged();
+    mSequenceTimer.start(0, this);
+}
+
+void ConversationChannel::addPendingEvent(int eventId)
+{
+    if (++mPendingEvents[eventId] == 1)
+        emit pendingEventAdded(eventId);
+}
+
+bool ConversationChannel::removePendingEvent(int eventId)
+{
+    QHash<int, int>::iterator it = mPendingEvents.find(eventId);
+    if (it != mPendingEvents.end() && --(*it) == 0) {
+        mPendingEvents.erase(it);
+        emit pendingEventRemoved(eventId);
+        return true;
+    }
+    return false;
+}
+
+void ConversationChannel::eventStatusReported(int eventId)
+{
+    // Every send of this event has now been recorded by commhistory; the deadlines of these
+    // sends will be ignored, as a later send of the event has a new generation
+    QHash<int, SentEvent>::iterator it = mSentEvents.find(eventId);
+    if (it == mSentEvents.end())
+        return;
+
+    const int count = it->count;
+    mSentEvents.erase(it);
+
+    bool removed = false;
+    for (int i = 0; i < count; ++i)
+        removed |= removePendingEvent(eventId);
+    if (removed)
+        reportPendingSetChanged();
 }
 
 void ConversationChannel::timerEvent(QTimerEvent *timerEvent)
 {
-    if (timerEvent->timerId() == mTimer.timerId()) {
-        mTimer.stop();
-
-        // Remove any sent operations that have expired
-        foreach (int eventId, mSentEvents) {
-            QList<QPair<Tp::PendingOperation *, int> >::iterator it = mPendingSends.begin();
-            while (it != mPendingSends.end()) {
-                if ((*it).second == eventId) {
-                    it = mPendingSends.erase(it);
-                } else {
-                    ++it;
-                }
-            }
+    if (timerEvent->timerId() == mSequenceTimer.timerId()) {
+        mSequenceTimer.stop();
+        emit sequenceChanged();
+    } else if (timerEvent->timerId() == mRetryTimer.timerId()) {
+        mRetryTimer.stop();
+        if (!mPendingMessages.isEmpty())
+            ensureChannel();
+    } else if (timerEvent->timerId() == mTimer.timerId()) {
+        // Retire the sent events whose deadline has passed, unless they have already been reported
+        mRetirementSlot = (mRetirementSlot + 1) % RetirementSlotCount;
+
+        QList<RetirementDeadlineEntry> expired;
+        expired.swap(mRetirementWheel[mRetirementSlot]);
+        bool removed = false;
+        foreach (const RetirementDeadlineEntry &deadline, expired) {
+            // A deadline belonging to sends that were reported does not apply to a later send
+            QHash<int, SentEvent>::iterator it = mSentEvents.find(deadline.eventId);
+            if (it == mSentEvents.end() || it->generation != deadline.generation)
+                continue;
+
+            if (--it->count == 0)
+                mSentEvents.erase(it);
+            removed |= removePendingEvent(deadline.eventId);
+        }
+        if (removed)
+            reportPendingSetChanged();
+
+        // Deadlines remaining for reported events are no longer needed
+        if (mSentEvents.isEmpty()) {
+            mTimer.stop();
+            for (int slot = 0; slot < RetirementSlotCount; ++slot)
+                mRetirementWheel[slot].clear();
         }
-        mSentEvents.clear();
     }
 }
-
@@ -34,6 +34,9 @@
 
 #include <QObject>
 #include <QBasicTimer>
+#include <QHash>
+#include <QQueue>
+#include <TelepathyQt/AccountManager>
 #include <TelepathyQt/PendingChannelRequest>
 #include <TelepathyQt/ChannelRequest>
 #include <TelepathyQt/Channel>
@@ -50,6 +53,9 @@ class ConversationChannel : public QObject
     Q_PROPERTY(QString localUid READ localUid CONSTANT)
     Q_PROPERTY(QString remoteUid READ remoteUid CONSTANT)
     Q_PROPERTY(int sequence READ sequence NOTIFY sequenceChanged)
+    Q_PROPERTY(int maximumInFlight READ maximumInFlight WRITE setMaximumInFlight NOTIFY maximumInFlightChanged)
+    Q_PROPERTY(int queuedCount READ queuedCount NOTIFY queuedCountChanged)
+    Q_PROPERTY(int inFlightCount READ inFlightCount NOTIFY inFlightCountChanged)
 
 public:
     enum State {
@@ -69,15 +75,25 @@ public:
     QString remoteUid() const { return mRemoteUid; }
     int sequence() const { return mSequence; }
 
+    // The number of messages sent to telepathy at once; further messages are queued, or 0 for no limit
+    int maximumInFlight() const { return mMaximumInFlight; }
+    void setMaximumInFlight(int maximum);
+
+    int queuedCount() const { return mPendingMessages.count(); }
+    int inFlightCount() const { return mPendingSends.count(); }
+
+    /* Requests the telepathy channel if it is not already established; this may be called before
+     * the first message is sent, so that the message need not wait for the channel */
     Q_INVOKABLE void ensureChannel();
     Q_INVOKABLE bool eventIsPending(int eventId) const;
 
     void addChannel(const Tp::ChannelPtr &channel);
 
-    void sendMessage(const Tp::MessagePartList &parts, int eventId, bool areadyPending);
-
     void channelDestroyed();
 
+    // Called when commhistory reports the event as sending or sent, so that it need not remain pending
+    void eventStatusReported(int eventId);
+
 public slots:
     void sendMessage(const QString &text, int eventId = -1);
 
@@ -88,8 +104,19 @@ signals:
     void sendingFailed(int eventId, ConversationChannel *sender);
     void sendingSucceeded(int eventId, ConversationChannel *sender);
     void sequenceChanged();
+    void maximumInFlightChanged();
+    void queuedCountChanged();
+    void inFlightCountChanged();
+
+    // Emitted when no messages remain queued or in flight, each having been sent or failed
+    void queueDrained();
+
+    // Emitted as an event enters or leaves the pending set, before the sequence changes
+    void pendingEventAdded(int eventId);
+    void pendingEventRemoved(int eventId);
 
 private slots:
+    void accountManagerReady(Tp::PendingOperation *op);
     void accountReadyForChannel(Tp::PendingOperation *op);
     void channelRequestCreated(const Tp::ChannelRequestPtr &request);
     void channelRequestSucceeded(const Tp::ChannelPtr &channel);
@@ -106,27 +133,77 @@ private:
     Tp::PendingChannelRequest *mPendingRequest;
     Tp::ChannelRequestPtr mRequest;
     QList<Tp::TextChannelPtr> mChannels;
+    Tp::AccountManagerPtr mAccountManager;
     Tp::AccountPtr mAccount;
+    bool mAccountPending;
     State mState;
 
     QString mLocalUid;
     QString mRemoteUid;
 
-    QList<QPair<Tp::MessagePartList, int> > mPendingMessages;
-    QList<QPair<Tp::PendingOperation *, int> > mPendingSends;
-    QList<int> mSentEvents;
+    /* A message waiting for the channel to become ready, or for room in the send window; its
+     * parts are only built once it is sent */
+    struct PendingMessage {
+        QString text;
+        int eventId;
+        // Milliseconds since the epoch at which the message was queued
+        qint64 queuedTime;
+    };
+    // Messages leave from the front as the send window opens, so a backlog drains in linear time
+    QQueue<PendingMessage> mPendingMessages;
+    QHash<Tp::PendingOperation *, int> mPendingSends;
+    // Sending a burst of messages at once can overwhelm the modem's queue
+    enum { DefaultMaximumInFlight = 4 };
+    int mMaximumInFlight;
+    /* The number of successful sends of each event which remain pending until commhistory reports
+     * them; the generation distinguishes the deadlines of these sends from those of an earlier
+     * send of the same event, which was already reported */
+    struct SentEvent {
+        int count;
+        int generation;
+    };
+    QHash<int, SentEvent> mSentEvents;
+    // The number of buffered messages and pending sends for each event
+    QHash<int, int> mPendingEvents;
     int mSequence;
-
+    QBasicTimer mSequenceTimer;
+
+    /* Sent events that commhistory does not report are retired after a deadline; the deadlines
+     * are kept in a timing wheel, whose slots are visited in turn while any event is sent */
+    enum { RetirementInterval = 250, RetirementSlotCount = 8, RetirementDeadline = 4 };
+    struct RetirementDeadlineEntry {
+        int eventId;
+        int generation;
+    };
+    QList<RetirementDeadlineEntry> mRetirementWheel[RetirementSlotCount];
+    int mRetirementSlot;
+    int mRetirementGeneration;
     QBasicTimer mTimer;
 
+    /* Queued messages survive the loss of the channel, which is requested again after a delay
+     * that doubles with each attempt; they fail once the attempts or their deadline run out */
+    enum { RetryInitialDelay = 1000, RetryMaximumDelay = 16000, RetryMaximumAttempts = 5, RetryDeadline = 60000 };
+    int mRetryAttempts;
+    QBasicTimer mRetryTimer;
+
     virtual void timerEvent(QTimerEvent *timerEvent);
 
     void setState(State newState);
     void start(Tp::PendingChannelRequest *request);
 
+    Tp::TextChannelPtr readyChannel() const;
+    bool sendWindowFull() const;
+    void transmitMessage(const Tp::TextChannelPtr &textChannel, const QString &text, int eventId);
+    void sendQueuedMessages();
+
+    void retryPendingMessages();
     void reportPendingFailed();
     void reportPendingSetChanged();
 
+    void addPendingEvent(int eventId);
+    // Returns whether the event has left the pending set
+    bool removePendingEvent(int eventId);
+
     int parseEventId(const Tp::MessagePartList &parts) const;
 };
 
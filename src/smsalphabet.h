@@ -0,0 +1,298 @@
+/* Copyright (C) 2015 Jolla Ltd
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMSALPHABET_H
+#define SMSALPHABET_H
+
+#include "smstextcounter.h"
+
+#include <QChar>
+
+#include <cstddef>
+
+// The GSM 03.38 character tables, shared by the character counter and the encoder
+namespace SmsAlphabet {
+
+// Each character is classified by a bitmask of the GSM 03.38 tables that can represent it
+enum CharacterTable {
+    DefaultBaseTable = 0x01,
+    DefaultShiftTable = 0x02,
+    TurkishBaseTable = 0x04,
+    TurkishShiftTable = 0x08,
+    SpanishShiftTable = 0x10,
+    PortugueseBaseTable = 0x20,
+    PortugueseShiftTable = 0x40
+};
+
+static_assert(int(PortugueseShiftTable) << 1 == int(SmsTextCounter::MembershipCount), "Table membership does not match the counted range");
+
+// Unicode values for the characters in the default GSM base character set
+constexpr ushort defaultBaseChars[] = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
+    0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+    0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0
+};
+
+// Unicode values for the characters in the default GSM shift character set
+constexpr ushort defaultShiftChars[] = {
+    0x000C,
+    0x005E,
+    0x007B,
+    0x007D,
+    0x005C,
+    0x005B,
+    0x007E,
+    0x005D,
+    0x007C,
+    0x20AC
+};
+
+// Codes following the escape for the characters in the default GSM shift character set
+constexpr quint8 defaultShiftCodes[] = {
+    0x0A, 0x14, 0x28, 0x29, 0x2F, 0x3C, 0x3D, 0x3E,
+    0x40, 0x65
+};
+
+static_assert(sizeof(defaultShiftCodes) == sizeof(defaultShiftChars) / sizeof(ushort), "Each character requires a code");
+
+// Unicode values for the characters in the Turkish national language locking shift table (3GPP TS 23.038 A.3.1)
+constexpr ushort turkishBaseChars[] = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x20AC, 0x00E9, 0x00F9, 0x0131,
+    0x00F2, 0x00C7, 0x000A, 0x011E, 0x011F, 0x000D, 0x00C5, 0x00E5,
+    0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
+    0x03A3, 0x0398, 0x039E, 0x00A0, 0x015E, 0x015F, 0x00DF, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x0130, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
+    0x00E7, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0
+};
+
+// Unicode values for the characters in the Turkish national language single shift table (3GPP TS 23.038 A.2.1)
+constexpr ushort turkishShiftChars[] = {
+    0x000C, 0x005E, 0x007B, 0x007D, 0x005C, 0x005B, 0x007E, 0x005D,
+    0x007C, 0x011E, 0x0130, 0x015E, 0x00E7, 0x20AC, 0x011F, 0x0131,
+    0x015F
+};
+
+// Codes following the escape for the characters in the Turkish single shift table
+constexpr quint8 turkishShiftCodes[] = {
+    0x0A, 0x14, 0x28, 0x29, 0x2F, 0x3C, 0x3D, 0x3E,
+    0x40, 0x47, 0x49, 0x53, 0x63, 0x65, 0x67, 0x69,
+    0x73
+};
+
+static_assert(sizeof(turkishShiftCodes) == sizeof(turkishShiftChars) / sizeof(ushort), "Each character requires a code");
+
+// Unicode values for the characters in the Spanish national language single shift table (3GPP TS 23.038 A.2.2)
+// Note: there is no Spanish locking shift table; the default base table is used with it
+constexpr ushort spanishShiftChars[] = {
+    0x00E7, 0x000C, 0x005E, 0x007B, 0x007D, 0x005C, 0x005B, 0x007E,
+    0x005D, 0x007C, 0x00C1, 0x00CD, 0x00D3, 0x00DA, 0x00E1, 0x20AC,
+    0x00ED, 0x00F3, 0x00FA
+};
+
+// Codes following the escape for the characters in the Spanish single shift table
+constexpr quint8 spanishShiftCodes[] = {
+    0x09, 0x0A, 0x14, 0x28, 0x29, 0x2F, 0x3C, 0x3D,
+    0x3E, 0x40, 0x41, 0x49, 0x4F, 0x55, 0x61, 0x65,
+    0x69, 0x6F, 0x75
+};
+
+static_assert(sizeof(spanishShiftCodes) == sizeof(spanishShiftChars) / sizeof(ushort), "Each character requires a code");
+
+// Unicode values for the characters in the Portuguese national language locking shift table (3GPP TS 23.038 A.3.3)
+constexpr ushort portugueseBaseChars[] = {
+    0x0040, 0x00A3, 0x0024, 0x00A5, 0x00EA, 0x00E9, 0x00FA, 0x00ED,
+    0x00F3, 0x00E7, 0x000A, 0x00D4, 0x00F4, 0x000D, 0x00C1, 0x00E1,
+    0x0394, 0x005F, 0x00AA, 0x00C7, 0x00C0, 0x221E, 0x005E, 0x005C,
+    0x20AC, 0x00D3, 0x007C, 0x00A0, 0x00C2, 0x00E2, 0x00CA, 0x00C9,
+    0x0020, 0x0021, 0x0022, 0x0023, 0x00BA, 0x0025, 0x0026, 0x0027,
+    0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
+    0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
+    0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
+    0x00CD, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
+    0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
+    0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
+    0x0058, 0x0059, 0x005A, 0x00C3, 0x00D5, 0x00DA, 0x00DC, 0x00A7,
+    0x007E, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
+    0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
+    0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
+    0x0078, 0x0079, 0x007A, 0x00E3, 0x00F5, 0x0060, 0x00FC, 0x00E0
+};
+
+// Unicode values for the characters in the Portuguese national language single shift table (3GPP TS 23.038 A.2.3)
+constexpr ushort portugueseShiftChars[] = {
+    0x00EA, 0x00E7, 0x000C, 0x00D4, 0x00F4, 0x00C1, 0x00E1, 0x03A6,
+    0x0393, 0x005E, 0x03A9, 0x03A0, 0x03A8, 0x03A3, 0x0398, 0x00CA,
+    0x007B, 0x007D, 0x005C, 0x005B, 0x007E, 0x005D, 0x007C, 0x00C0,
+    0x00CD, 0x00D3, 0x00DA, 0x00C3, 0x00D5, 0x00C2, 0x20AC, 0x00ED,
+    0x00F3, 0x00FA, 0x00E3, 0x00F5, 0x00E2
+};
+
+// Codes following the escape for the characters in the Portuguese single shift table
+constexpr quint8 portugueseShiftCodes[] = {
+    0x05, 0x09, 0x0A, 0x0B, 0x0C, 0x0E, 0x0F, 0x12,
+    0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1F,
+    0x28, 0x29, 0x2F, 0x3C, 0x3D, 0x3E, 0x40, 0x41,
+    0x49, 0x4F, 0x55, 0x5B, 0x5C, 0x61, 0x65, 0x69,
+    0x6F, 0x75, 0x7B, 0x7C, 0x7F
+};
+
+static_assert(sizeof(portugueseShiftCodes) == sizeof(portugueseShiftChars) / sizeof(ushort), "Each character requires a code");
+
+template <std::size_t N>
+constexpr bool tableContains(const ushort (&table)[N], ushort c, std::size_t i = 0)
+{
+    return i == N ? false : (table[i] == c ? true : tableContains(table, c, i + 1));
+}
+
+constexpr quint8 computeMembership(ushort c)
+{
+    return (tableContains(defaultBaseChars, c) ? DefaultBaseTable : 0)
+         | (tableContains(defaultShiftChars, c) ? DefaultShiftTable : 0)
+         | (tableContains(turkishBaseChars, c) ? TurkishBaseTable : 0)
+         | (tableContains(turkishShiftChars, c) ? TurkishShiftTable : 0)
+         | (tableContains(spanishShiftChars, c) ? SpanishShiftTable : 0)
+         | (tableContains(portugueseBaseChars, c) ? PortugueseBaseTable : 0)
+         | (tableContains(portugueseShiftChars, c) ? PortugueseShiftTable : 0);
+}
+
+// The tables only contain characters from a few pages of the BMP; each of those pages has a
+// precomputed membership table, and all other pages share an empty one
+constexpr quint8 pageSlot(ushort page)
+{
+    return page == 0x00 ? 1
+         : page == 0x01 ? 2
+         : page == 0x03 ? 3
+         : page == 0x20 ? 4
+         : page == 0x22 ? 5
+         : 0;
+}
+
+template <std::size_t N>
+constexpr bool tableIsPaged(const ushort (&table)[N], std::size_t i = 0)
+{
+    return i == N ? true : (pageSlot(table[i] >> 8) != 0 && tableIsPaged(table, i + 1));
+}
+
+static_assert(tableIsPaged(defaultBaseChars), "Default base table contains an unpaged character");
+static_assert(tableIsPaged(defaultShiftChars), "Default shift table contains an unpaged character");
+static_assert(tableIsPaged(turkishBaseChars), "Turkish base table contains an unpaged character");
+static_assert(tableIsPaged(turkishShiftChars), "Turkish shift table contains an unpaged character");
+static_assert(tableIsPaged(spanishShiftChars), "Spanish shift table contains an unpaged character");
+static_assert(tableIsPaged(portugueseBaseChars), "Portuguese base table contains an unpaged character");
+static_assert(tableIsPaged(portugueseShiftChars), "Portuguese shift table contains an unpaged character");
+
+#define MEMBERSHIP_ROW(c) \
+    computeMembership((c) + 0x0), computeMembership((c) + 0x1), computeMembership((c) + 0x2), computeMembership((c) + 0x3), \
+    computeMembership((c) + 0x4), computeMembership((c) + 0x5), computeMembership((c) + 0x6), computeMembership((c) + 0x7), \
+    computeMembership((c) + 0x8), computeMembership((c) + 0x9), computeMembership((c) + 0xA), computeMembership((c) + 0xB), \
+    computeMembership((c) + 0xC), computeMembership((c) + 0xD), computeMembership((c) + 0xE), computeMembership((c) + 0xF)
+#define MEMBERSHIP_PAGE(page) { \
+    MEMBERSHIP_ROW((page) << 8 | 0x00), MEMBERSHIP_ROW((page) << 8 | 0x10), MEMBERSHIP_ROW((page) << 8 | 0x20), MEMBERSHIP_ROW((page) << 8 | 0x30), \
+    MEMBERSHIP_ROW((page) << 8 | 0x40), MEMBERSHIP_ROW((page) << 8 | 0x50), MEMBERSHIP_ROW((page) << 8 | 0x60), MEMBERSHIP_ROW((page) << 8 | 0x70), \
+    MEMBERSHIP_ROW((page) << 8 | 0x80), MEMBERSHIP_ROW((page) << 8 | 0x90), MEMBERSHIP_ROW((page) << 8 | 0xA0), MEMBERSHIP_ROW((page) << 8 | 0xB0), \
+    MEMBERSHIP_ROW((page) << 8 | 0xC0), MEMBERSHIP_ROW((page) << 8 | 0xD0), MEMBERSHIP_ROW((page) << 8 | 0xE0), MEMBERSHIP_ROW((page) << 8 | 0xF0) }
+#define SLOT_ROW(p) \
+    pageSlot((p) + 0x0), pageSlot((p) + 0x1), pageSlot((p) + 0x2), pageSlot((p) + 0x3), \
+    pageSlot((p) + 0x4), pageSlot((p) + 0x5), pageSlot((p) + 0x6), pageSlot((p) + 0x7), \
+    pageSlot((p) + 0x8), pageSlot((p) + 0x9), pageSlot((p) + 0xA), pageSlot((p) + 0xB), \
+    pageSlot((p) + 0xC), pageSlot((p) + 0xD), pageSlot((p) + 0xE), pageSlot((p) + 0xF)
+
+// Both levels are evaluated by the compiler, so the tables are immutable data with no initialization
+constexpr quint8 pageSlots[256] = {
+    SLOT_ROW(0x00), SLOT_ROW(0x10), SLOT_ROW(0x20), SLOT_ROW(0x30),
+    SLOT_ROW(0x40), SLOT_ROW(0x50), SLOT_ROW(0x60), SLOT_ROW(0x70),
+    SLOT_ROW(0x80), SLOT_ROW(0x90), SLOT_ROW(0xA0), SLOT_ROW(0xB0),
+    SLOT_ROW(0xC0), SLOT_ROW(0xD0), SLOT_ROW(0xE0), SLOT_ROW(0xF0)
+};
+
+constexpr quint8 membershipPages[][256] = {
+    { 0 },
+    MEMBERSHIP_PAGE(0x00),
+    MEMBERSHIP_PAGE(0x01),
+    MEMBERSHIP_PAGE(0x03),
+    MEMBERSHIP_PAGE(0x20),
+    MEMBERSHIP_PAGE(0x22)
+};
+
+#undef MEMBERSHIP_ROW
+#undef MEMBERSHIP_PAGE
+#undef SLOT_ROW
+
+inline quint8 tableMembership(const QChar &c)
+{
+    const ushort u(c.unicode());
+    return membershipPages[pageSlots[u >> 8]][u & 0xFF];
+}
+
+inline quint8 baseTable(SmsTextCounter::Encoding encoding)
+{
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return TurkishBaseTable;
+    case SmsTextCounter::Portuguese: return PortugueseBaseTable;
+    default: return DefaultBaseTable;
+    }
+}
+
+inline quint8 shiftTable(SmsTextCounter::Encoding encoding)
+{
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return TurkishShiftTable;
+    case SmsTextCounter::Spanish: return SpanishShiftTable;
+    case SmsTextCounter::Portuguese: return PortugueseShiftTable;
+    default: return DefaultShiftTable;
+    }
+}
+
+}
+
+#endif
@@ -30,203 +30,221 @@
 
 #include "smscharactercounter.h"
 
-#include <QChar>
-#include <QVector>
+#include <QCache>
+#include <QFutureWatcher>
+#include <QMutex>
+#include <QQuickTextDocument>
+#include <QTextCursor>
+#include <QTextDocument>
+#include <QtConcurrent>
 #include <QtDebug>
 
-#include <algorithm>
-
 namespace {
 
-void populateSet(QVector<uint> &set, const uint *chars, std::size_t n)
+// Identifies a text as counted with particular settings
+struct CountCacheKey
 {
-    set.reserve(n);
-    for (const uint *it = chars, *end = it + n; it != end; ++it) {
-        set.append(*it);
-    }
-    std::sort(set.begin(), set.end());
-}
-
-template <std::size_t N>
-void populateSet(QVector<uint> &set, const uint (&chars)[N])
-{
-    return populateSet(set, chars, N);
-}
-
-const QVector<uint> *defaultCharacterSet() {
-    static QVector<uint> set;
-    static bool initialised = false;
-
-    if (!initialised) {
-        // Unicode values for the characters in the default GSM base character set
-        const uint baseChars[] = {
-            0x0040, 0x00A3, 0x0024, 0x00A5, 0x00E8, 0x00E9, 0x00F9, 0x00EC,
-            0x00F2, 0x00C7, 0x000A, 0x00D8, 0x00F8, 0x000D, 0x00C5, 0x00E5,
-            0x0394, 0x005F, 0x03A6, 0x0393, 0x039B, 0x03A9, 0x03A0, 0x03A8,
-            0x03A3, 0x0398, 0x039E, 0x00A0, 0x00C6, 0x00E6, 0x00DF, 0x00C9,
-            0x0020, 0x0021, 0x0022, 0x0023, 0x00A4, 0x0025, 0x0026, 0x0027,
-            0x0028, 0x0029, 0x002A, 0x002B, 0x002C, 0x002D, 0x002E, 0x002F,
-            0x0030, 0x0031, 0x0032, 0x0033, 0x0034, 0x0035, 0x0036, 0x0037,
-            0x0038, 0x0039, 0x003A, 0x003B, 0x003C, 0x003D, 0x003E, 0x003F,
-            0x00A1, 0x0041, 0x0042, 0x0043, 0x0044, 0x0045, 0x0046, 0x0047,
-            0x0048, 0x0049, 0x004A, 0x004B, 0x004C, 0x004D, 0x004E, 0x004F,
-            0x0050, 0x0051, 0x0052, 0x0053, 0x0054, 0x0055, 0x0056, 0x0057,
-            0x0058, 0x0059, 0x005A, 0x00C4, 0x00D6, 0x00D1, 0x00DC, 0x00A7,
-            0x00BF, 0x0061, 0x0062, 0x0063, 0x0064, 0x0065, 0x0066, 0x0067,
-            0x0068, 0x0069, 0x006A, 0x006B, 0x006C, 0x006D, 0x006E, 0x006F,
-            0x0070, 0x0071, 0x0072, 0x0073, 0x0074, 0x0075, 0x0076, 0x0077,
-            0x0078, 0x0079, 0x007A, 0x00E4, 0x00F6, 0x00F1, 0x00FC, 0x00E0
-        };
-
-        populateSet(set, baseChars);
-        initialised = true;
-    }
+    QString text;
+    SmsTextCounter::Encoding alphabet;
+    bool reduce;
 
-    return &set;
-}
-
-const QVector<uint> *defaultShiftCharacterSet() {
-    static QVector<uint> set;
-    static bool initialised = false;
-
-    if (!initialised) {
-        // Unicode values for the characters in the default GSM shift character set
-        const uint shiftChars[] = {
-            0x000C,
-            0x005E,
-            0x007B,
-            0x007D,
-            0x005C,
-            0x005B,
-            0x007E,
-            0x005D,
-            0x007C,
-            0x20AC
-        };
-
-        populateSet(set, shiftChars);
-        initialised = true;
+    bool operator==(const CountCacheKey &other) const
+    {
+        return alphabet == other.alphabet && reduce == other.reduce && text == other.text;
     }
+};
 
-    return &set;
+uint qHash(const CountCacheKey &key, uint seed = 0)
+{
+    return qHash(key.text, seed) ^ ((uint(key.alphabet) << 1) | uint(key.reduce));
 }
 
-bool setContains(const QVector<uint> &set, const QChar &c)
+// The cache holds approximately this many bytes, with each entry costing the memory occupied
+// by its counter, whose text the key shares
+const int countCacheCapacity = 2 * 1024 * 1024;
+
+QString encodingName(SmsTextCounter::Encoding encoding)
 {
-    return std::binary_search(set.constBegin(), set.constEnd(), c.unicode());
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return QStringLiteral("turkish");
+    case SmsTextCounter::Spanish: return QStringLiteral("spanish");
+    case SmsTextCounter::Portuguese: return QStringLiteral("portuguese");
+    case SmsTextCounter::UCS2: return QStringLiteral("ucs2");
+    default: return QStringLiteral("default");
+    }
 }
 
 }
 
+// The results of counting recent texts, shared between threads
+struct SmsCharacterCounter::CountCache
+{
+    CountCache() : counts(countCacheCapacity), hitCount(0), missCount(0) {}
+
+    QMutex mutex;
+    QCache<CountCacheKey, SmsTextCounter> counts;
+    int hitCount;
+    int missCount;
+};
+
 SmsCharacterCounter::SmsCharacterCounter(QObject *parent)
     : QObject(parent)
     , m_messageCount(0)
     , m_remainingCharacterCount(0)
-    , m_characterCount(0)
-    , m_baseEncoding(Default)
-    , m_shiftEncoding(Default)
-    , m_baseSet(0)
-    , m_shiftSet(0)
+    , m_unsupportedCount(0)
+    , m_encodingCandidates(m_counter.encodingCandidates())
+    , m_asynchronousThreshold(0)
+    , m_busy(false)
+    , m_pendingReplacesText(false)
+{
+}
+
+SmsCharacterCounter::~SmsCharacterCounter()
 {
+    // Any count still in progress is no longer wanted
+    cancelPendingCount();
 }
 
 QString SmsCharacterCounter::text() const
 {
-    return m_text;
+    return m_counter.text();
 }
 
 void SmsCharacterCounter::setText(const QString &t)
 {
-    // We need to determine how this string will be encoded into SMS by ofono;
-    // the relevant function is sms_text_prepare_with_alphabet() in smsutil.c
-
-    // Ofono will encode the text using the first possible from:
-    // a) the default GSM 03.38 7-bit dialect
-    // b) the dialect corresponding to the ofono 'sms/Alphabet' setting value
-    //    (note: ofono tries first with single shift, then with both single and locking shift)
-    // c) UCS-2 encoding
-
-    // I'm not sure how ofono gets configured to use a specific alphabet (possibly
-    // derived from locale environment settings) but it is entirely possible that
-    // it is effectively unused in mer. In any case, it is not currently implemented
-    // here - which means that this estimate might be pessimistic by suggesting the
-    // UCS-2 encoding counts when a GSM dialect may actually be used by ofono.
-
-    // Ensure that our string is fully normalized
-    const QString normalized(t.normalized(QString::NormalizationForm_KC));
-    if (normalized != m_text) {
-        if (!m_text.isEmpty() && normalized.startsWith(m_text)) {
-            // This is an extension to the previous string, append the remainder
-            foreach (const QChar &c, normalized.mid(m_text.length())) {
-                appendCharacter(c);
-            }
-        } else if (m_baseEncoding == Default && !m_text.isEmpty() && m_text.startsWith(normalized)) {
-            // Characters have been removed from our text - we can only handle this by subtraction
-            // if the default character set is is use; otherwise we don't know which characters
-            // were responsible for forcing us to use an encoding, and we need to restart
-            int diff = m_text.count() - normalized.count();
-            while (--diff >= 0) {
-                removeCharacter();
-            }
-        } else {
-            // Start from the beginning
-            m_text.clear();
-            m_text.reserve(normalized.count());
-            m_characterCount = 0;
-            m_baseEncoding = Default;
-            m_shiftEncoding = Default;
-            m_baseSet = defaultCharacterSet();
-            m_shiftSet = defaultShiftCharacterSet();
-
-            foreach (const QChar &c, normalized) {
-                appendCharacter(c);
-            }
-        }
+    // A count in progress is for an older text; our own text remains consistent with our counts
+    if (m_pendingCount) {
+        if (t == m_pendingText)
+            return;
+        cancelPendingCount();
+    }
 
-        // The text has been modified
-        emit textChanged();
+    applyTextEdit(m_counter.textEdit(t));
+}
 
-        // Update the counts
+void SmsCharacterCounter::applyEdit(int position, int removedLength, const QString &inserted)
+{
+    const int sourceLength = m_pendingCount ? m_pendingText.length() : m_counter.sourceText().length();
+    if (position < 0 || removedLength < 0 || position + removedLength > sourceLength) {
+        qWarning() << "Invalid SMS text edit:" << position << removedLength << "of" << sourceLength;
+        return;
+    }
 
-        // If we encode with alternate character sets, we must include that information in the header
-        const int overheadFromBaseEncoding = (m_baseEncoding == Default || m_baseEncoding == UCS2) ? 0 : 3;
-        const int overheadFromShiftEncoding = m_shiftEncoding == Default ? 0 : 3;
-        const int overheadFromEncoding = overheadFromBaseEncoding + overheadFromShiftEncoding;
+    // Edits to a text still being counted are applied to that text
+    if (m_pendingCount) {
+        QString source(m_pendingText);
+        setText(source.replace(position, removedLength, inserted));
+        return;
+    }
 
-        // A single SMS allows 140 bytes (160 septets), for both data and header
-        const int maxSegmentBytes = 140;
+    applyTextEdit(m_counter.textEdit(position, removedLength, inserted));
+}
 
-        // UCS2 requires 16 bits per character, all other encodings require 7 bits
-        const int bitsPerCharacter(m_baseEncoding == UCS2 ? 16 : 7);
+void SmsCharacterCounter::applyTextEdit(const SmsTextCounter::Edit &edit)
+{
+    /* A text replacing ours entirely, as when a delegate is reused for a different draft, may
+     * already have been counted; edits that only modify part of our text are not looked up, even
+     * where the span counted again extends to both ends */
+    if (edit.replacesText && applyCachedCount(edit.source))
+        return;
+
+    // Large edits, such as pasting a long text, are counted without blocking the caller
+    if (m_asynchronousThreshold > 0 && edit.span.length() > m_asynchronousThreshold) {
+        countAsynchronously(m_counter.editedText(edit), edit.replacesText);
+        return;
+    }
 
-        // If the header is required, 1 additional byte is needed for the header length field
-        int overhead(overheadFromEncoding ? overheadFromEncoding + 1 : 0);
+    setBusy(false);
+    publishCounts(m_counter.applyEdit(edit));
 
-        int segmentBytesAvailable(maxSegmentBytes - overhead);
-        int segmentCharactersAvailable((segmentBytesAvailable * 8) / bitsPerCharacter);
+    if (edit.replacesText)
+        cacheCount(m_counter);
+}
 
-        if (m_characterCount > segmentCharactersAvailable) {
-            // We must allocate 5 additional header bytes for each packet's segmentation framing
-            // Note: ofono does not currently use the 16-bit segmentation count option
-            overhead += (overhead ? 5 : 6);
-            segmentBytesAvailable = maxSegmentBytes - overhead;
-            segmentCharactersAvailable = (segmentBytesAvailable * 8) / bitsPerCharacter;
-        }
+QQuickTextDocument *SmsCharacterCounter::document() const
+{
+    return m_document;
+}
 
-        const int remainder = (m_characterCount % segmentCharactersAvailable);
+void SmsCharacterCounter::setDocument(QQuickTextDocument *document)
+{
+    if (m_document == document)
+        return;
 
-        const int messageCount = (m_characterCount / segmentCharactersAvailable) + (remainder ? 1 : 0);
-        if (m_messageCount != messageCount) {
-            m_messageCount = messageCount;
-            emit messageCountChanged();
-        }
+    if (m_document)
+        disconnect(m_document->textDocument(), 0, this, 0);
 
-        const int remainingCharacterCount = remainder ? (segmentCharactersAvailable - remainder) : 0;
-        if (m_remainingCharacterCount != remainingCharacterCount) {
-            m_remainingCharacterCount = remainingCharacterCount;
-            emit remainingCharacterCountChanged();
+    m_document = document;
+    if (m_document) {
+        connect(m_document->textDocument(), &QTextDocument::contentsChange, this, &SmsCharacterCounter::documentContentsChange);
+        setText(m_document->textDocument()->toPlainText());
+    }
+    emit documentChanged();
+}
+
+void SmsCharacterCounter::documentContentsChange(int position, int charsRemoved, int charsAdded)
+{
+    QTextDocument *textDocument(m_document->textDocument());
+
+    // Extract the added characters as QTextDocument::toPlainText() would
+    QTextCursor cursor(textDocument);
+    cursor.setPosition(position);
+    cursor.setPosition(position + charsAdded, QTextCursor::KeepAnchor);
+    QString inserted(cursor.selectedText());
+    for (QChar *it = inserted.data(), *end = it + inserted.length(); it != end; ++it) {
+        switch (it->unicode()) {
+        case 0xFDD0: // QTextBeginningOfFrame
+        case 0xFDD1: // QTextEndOfFrame
+        case QChar::ParagraphSeparator:
+        case QChar::LineSeparator:
+            *it = QLatin1Char('\n');
+            break;
+        case QChar::Nbsp:
+            *it = QLatin1Char(' ');
+            break;
+        default:
+            break;
         }
     }
+
+    // The document may report changes extending past its end, such as when its content is
+    // replaced entirely; count the whole text again in that case
+    const int sourceLength = m_pendingCount ? m_pendingText.length() : m_counter.sourceText().length();
+    if (inserted.length() != charsAdded || position + charsRemoved > sourceLength) {
+        setText(textDocument->toPlainText());
+    } else {
+        applyEdit(position, charsRemoved, inserted);
+    }
+}
+
+QString SmsCharacterCounter::alphabet() const
+{
+    return encodingName(m_counter.alphabet());
+}
+
+void SmsCharacterCounter::setAlphabet(const QString &alphabet)
+{
+    SmsTextCounter::Encoding encoding(SmsTextCounter::Default);
+    if (alphabet == QLatin1String("turkish")) {
+        encoding = SmsTextCounter::Turkish;
+    } else if (alphabet == QLatin1String("spanish")) {
+        encoding = SmsTextCounter::Spanish;
+    } else if (alphabet == QLatin1String("portuguese")) {
+        encoding = SmsTextCounter::Portuguese;
+    } else if (!alphabet.isEmpty() && alphabet != QLatin1String("default")) {
+        qWarning() << "Unsupported SMS alphabet:" << alphabet;
+    }
+
+    if (m_counter.alphabet() != encoding) {
+        // Characters substituted for the previous alphabet may be substituted differently
+        const bool modified(m_counter.setAlphabet(encoding));
+        emit alphabetChanged();
+        publishCounts(modified);
+
+        // A text still being counted must be counted again with the alternatives now available
+        if (m_pendingCount)
+            restartPendingCount();
+    }
 }
 
 int SmsCharacterCounter::messageCount() const
@@ -239,70 +257,276 @@ int SmsCharacterCounter::remainingCharacterCount() const
     return m_remainingCharacterCount;
 }
 
-void SmsCharacterCounter::appendCharacter(const QChar &c)
+QList<int> SmsCharacterCounter::segmentBoundaries() const
 {
-    if (m_baseEncoding == UCS2) {
-        ++m_characterCount;
-    } else {
-        // Test for representability in the current character sets
-        if (setContains(*m_baseSet, c)) {
-            // This character is representable in the current base set
-            m_characterCount += 1;
-        } else {
-            if (setContains(*m_shiftSet, c)) {
-                // This character is representable in the current shift set with an escape sequence
-                m_characterCount += 2;
-            } else {
-                // This character cannot be represented in the current encoding
-
-                if (m_baseEncoding == Default) {
-                    /* TODO: Switch to alternative alphabet encoding if possible
-                    Encoding alternateEncoding(...);
-                    if (reencode(alternateEncoding)) {
-                        return appendCharacter(c);
-                    }
-                    */ 
-                }
-
-                // Fallback to UCS2
-                reencode(UCS2);
-                return appendCharacter(c);
-            }
+    return m_segmentBoundaries;
+}
+
+int SmsCharacterCounter::asynchronousThreshold() const
+{
+    return m_asynchronousThreshold;
+}
+
+void SmsCharacterCounter::setAsynchronousThreshold(int threshold)
+{
+    if (m_asynchronousThreshold != threshold) {
+        m_asynchronousThreshold = threshold;
+        emit asynchronousThresholdChanged();
+    }
+}
+
+bool SmsCharacterCounter::busy() const
+{
+    return m_busy;
+}
+
+void SmsCharacterCounter::setBusy(bool busy)
+{
+    if (m_busy != busy) {
+        m_busy = busy;
+        emit busyChanged();
+    }
+}
+
+QVariantList SmsCharacterCounter::unsupportedCharacters() const
+{
+    QVariantList characters;
+    foreach (const SmsTextCounter::UnsupportedCharacter &unsupported, m_counter.unsupportedCharacters()) {
+        QVariantMap character;
+        character.insert(QStringLiteral("position"), unsupported.position);
+        character.insert(QStringLiteral("character"), unsupported.character);
+        if (!unsupported.substitute.isEmpty())
+            character.insert(QStringLiteral("substitute"), unsupported.substitute);
+        characters.append(character);
+    }
+    return characters;
+}
+
+int SmsCharacterCounter::reducedMessageCount() const
+{
+    return m_counter.reducedMessageCount();
+}
+
+bool SmsCharacterCounter::reduce() const
+{
+    return m_counter.reduce();
+}
+
+void SmsCharacterCounter::setReduce(bool reduce)
+{
+    if (m_counter.reduce() != reduce) {
+        // Any unsupported characters we already have are substituted, or restored
+        const bool modified(m_counter.setReduce(reduce));
+        emit reduceChanged();
+        publishCounts(modified);
+
+        if (m_pendingCount)
+            restartPendingCount();
+    }
+}
+
+QVariantList SmsCharacterCounter::encodingCandidates() const
+{
+    QVariantList candidates;
+    foreach (const SmsTextCounter::EncodingCandidate &candidate, m_encodingCandidates) {
+        QVariantMap result;
+        result.insert(QStringLiteral("encoding"), encodingName(candidate.baseEncoding == SmsTextCounter::UCS2 ? SmsTextCounter::UCS2 : candidate.shiftEncoding));
+        result.insert(QStringLiteral("lockingShift"), candidate.lockingShift);
+        result.insert(QStringLiteral("viable"), candidate.viable);
+        result.insert(QStringLiteral("characterCount"), candidate.characterCount);
+        candidates.append(result);
+    }
+    return candidates;
+}
+
+int SmsCharacterCounter::truncatedLength(int segmentCount) const
+{
+    return m_counter.truncatedLength(segmentCount);
+}
+
+int SmsCharacterCounter::remainingCharacterCountWithin(int segmentCount) const
+{
+    return m_counter.remainingCharacterCountWithin(segmentCount);
+}
+
+void SmsCharacterCounter::countAsynchronously(const QString &text, bool replacesText)
+{
+    QSharedPointer<QAtomicInt> cancelled(new QAtomicInt(0));
+    m_pendingCount = cancelled;
+    m_pendingText = text;
+    m_pendingReplacesText = replacesText;
+
+    // As for counts made immediately, only texts that replaced ours entirely are cached
+    QFutureWatcher<SmsTextCounter> *watcher = new QFutureWatcher<SmsTextCounter>(this);
+    connect(watcher, &QFutureWatcherBase::finished, this, [this, watcher, cancelled, replacesText]() {
+        watcher->deleteLater();
+        if (!cancelled->loadAcquire()) {
+            applyCount(watcher->result());
+            if (replacesText)
+                cacheCount(watcher->result());
         }
+    });
+
+    // The worker counts the text with its own counter, so it shares no state with ours
+    const SmsTextCounter::Encoding alphabet(m_counter.alphabet());
+    const bool reduce(m_counter.reduce());
+    watcher->setFuture(QtConcurrent::run([text, alphabet, reduce, cancelled]() {
+        SmsTextCounter counter(alphabet, reduce);
+        counter.setCancellation(cancelled.data());
+        counter.setText(text);
+        // Our counter adopts the result, which must not refer to the flag beyond this count
+        counter.setCancellation(0);
+        return counter;
+    }));
+
+    setBusy(true);
+}
+
+void SmsCharacterCounter::cancelPendingCount()
+{
+    if (m_pendingCount) {
+        m_pendingCount->storeRelease(1);
+        m_pendingCount.clear();
+        m_pendingText.clear();
     }
+}
 
-    // The character is now part of the message
-    m_text.append(c);
+void SmsCharacterCounter::restartPendingCount()
+{
+    // The text must be counted again with the current settings
+    const QString text(m_pendingText);
+    const bool replacesText(m_pendingReplacesText);
+    cancelPendingCount();
+    countAsynchronously(text, replacesText);
 }
 
-void SmsCharacterCounter::removeCharacter()
+void SmsCharacterCounter::applyCount(const SmsTextCounter &counter)
 {
-    const QChar c(m_text.at(m_text.count() - 1));
+    m_pendingCount.clear();
+    m_pendingText.clear();
 
-    // We only remove characters if using the default set
-    if (setContains(*m_shiftSet, c)) {
-        m_characterCount -= 2;
-    } else {
-        // the character must be in the default base set
-        m_characterCount -= 1;
+    const bool modified(m_counter.text() != counter.text());
+    m_counter = counter;
+    publishCounts(modified);
+    setBusy(false);
+}
+
+SmsCharacterCounter::CountCache &SmsCharacterCounter::countCache()
+{
+    static CountCache cache;
+    return cache;
+}
+
+int SmsCharacterCounter::cacheHitCount()
+{
+    CountCache &cache(countCache());
+    QMutexLocker locker(&cache.mutex);
+    return cache.hitCount;
+}
+
+int SmsCharacterCounter::cacheMissCount()
+{
+    CountCache &cache(countCache());
+    QMutexLocker locker(&cache.mutex);
+    return cache.missCount;
+}
+
+void SmsCharacterCounter::clearCache()
+{
+    CountCache &cache(countCache());
+    QMutexLocker locker(&cache.mutex);
+    cache.counts.clear();
+    cache.hitCount = 0;
+    cache.missCount = 0;
+}
+
+bool SmsCharacterCounter::applyCachedCount(const QString &text)
+{
+    const CountCacheKey key = { text, m_counter.alphabet(), m_counter.reduce() };
+
+    CountCache &cache(countCache());
+    QMutexLocker locker(&cache.mutex);
+    const SmsTextCounter *cached = cache.counts.object(key);
+    if (!cached) {
+        ++cache.missCount;
+        return false;
     }
+    ++cache.hitCount;
+
+    // Our signal handlers may count other texts, so the counter must be copied before emitting
+    const SmsTextCounter counter(*cached);
+    locker.unlock();
 
-    m_text.chop(1);
+    applyCount(counter);
+    return true;
 }
 
-bool SmsCharacterCounter::reencode(Encoding newEncoding)
+void SmsCharacterCounter::cacheCount(const SmsTextCounter &counter) const
 {
-    // Test if the text can be represented in the new encoding, and if so, determine the new character count
-    if (newEncoding == UCS2) {
-        // All characters can be represented, each as a single 16-bit value
-        m_characterCount = m_text.length();
-        m_baseEncoding = UCS2;
-        m_shiftEncoding = Default;
-        return true;
-    } else {
-        // TODO: test against alternative language sets
+    /* The whole counter is kept, rather than only its counts, so that a counter adopting it can
+     * continue with incremental edits; the state it can rebuild on demand is released, and the
+     * key shares the counter's text */
+    SmsTextCounter *cached = new SmsTextCounter(counter);
+    cached->squeeze();
+    const CountCacheKey key = { cached->sourceText(), counter.alphabet(), counter.reduce() };
+
+    CountCache &cache(countCache());
+    QMutexLocker locker(&cache.mutex);
+    cache.counts.insert(key, cached, cached->memoryCost());
+}
+
+QVariantList SmsCharacterCounter::countTexts(const QStringList &texts) const
+{
+    QVariantList results;
+    results.reserve(texts.count());
+
+    foreach (const SmsTextCounter::TextCount &count, SmsTextCounter::countTexts(texts, m_counter.alphabet())) {
+        // Report the national language in use, if any; its tables are always used for the single shift
+        QVariantMap result;
+        result.insert(QStringLiteral("encoding"), encodingName(count.baseEncoding == SmsTextCounter::UCS2 ? SmsTextCounter::UCS2 : count.shiftEncoding));
+        result.insert(QStringLiteral("messageCount"), count.messageCount);
+        result.insert(QStringLiteral("remainingCharacterCount"), count.remainingCharacterCount);
+        results.append(result);
     }
 
-    return false;
+    return results;
 }
 
+void SmsCharacterCounter::publishCounts(bool textModified)
+{
+    // Each property is notified only if our counter's value for it has changed
+    if (textModified)
+        emit textChanged();
+
+    const QList<int> segmentBoundaries(m_counter.segmentBoundaries());
+    if (m_segmentBoundaries != segmentBoundaries) {
+        m_segmentBoundaries = segmentBoundaries;
+        emit segmentBoundariesChanged();
+    }
+
+    const int messageCount = m_counter.messageCount();
+    const bool messageCountModified(m_messageCount != messageCount);
+    if (messageCountModified) {
+        m_messageCount = messageCount;
+        emit messageCountChanged();
+    }
+
+    // The reduced message count may change along with the message count
+    const int unsupportedCount = m_counter.unsupportedCount();
+    if (unsupportedCount || m_unsupportedCount || messageCountModified) {
+        m_unsupportedCount = unsupportedCount;
+        emit unsupportedCharactersChanged();
+    }
+
+    const int remainingCharacterCount = m_counter.remainingCharacterCount();
+    if (m_remainingCharacterCount != remainingCharacterCount) {
+        m_remainingCharacterCount = remainingCharacterCount;
+        emit remainingCharacterCountChanged();
+    }
+
+    const QVector<SmsTextCounter::EncodingCandidate> encodingCandidates(m_counter.encodingCandidates());
+    if (m_encodingCandidates != encodingCandidates) {
+        m_encodingCandidates = encodingCandidates;
+        emit encodingCandidatesChanged();
+    }
+}
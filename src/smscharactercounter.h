@@ -31,48 +31,158 @@
 #ifndef SMSCHARACTERCOUNTER_H
 #define SMSCHARACTERCOUNTER_H
 
+#include "smstextcounter.h"
+
+#include <QAtomicInt>
+#include <QList>
 #include <QObject>
+#include <QPointer>
+#include <QSharedPointer>
+#include <QStringList>
+#include <QVariant>
 #include <QVector>
 
+class QQuickTextDocument;
+
+// Exposes an SmsTextCounter to QML, counting large edits in a worker thread
 class SmsCharacterCounter : public QObject
 {
     Q_OBJECT
    
     Q_PROPERTY(QString text READ text WRITE setText NOTIFY textChanged)
+
+    /* A text document, such as that of a TextEdit, whose content is counted as the text; as the
+     * document changes, only its modified characters are examined */
+    Q_PROPERTY(QQuickTextDocument *document READ document WRITE setDocument NOTIFY documentChanged)
     Q_PROPERTY(int messageCount READ messageCount NOTIFY messageCountChanged)
     Q_PROPERTY(int remainingCharacterCount READ remainingCharacterCount NOTIFY remainingCharacterCountChanged)
 
+    /* The positions in the text at which each message after the first begins; each message ends
+     * where the next begins, and the last ends at the end of the text */
+    Q_PROPERTY(QList<int> segmentBoundaries READ segmentBoundaries NOTIFY segmentBoundariesChanged)
+
+    /* Edits modifying more characters than this are counted in a worker thread, during which busy
+     * is true and the other properties describe the preceding text; zero (the default) counts all
+     * edits immediately */
+    Q_PROPERTY(int asynchronousThreshold READ asynchronousThreshold WRITE setAsynchronousThreshold NOTIFY asynchronousThresholdChanged)
+    Q_PROPERTY(bool busy READ busy NOTIFY busyChanged)
+
+    /* The characters which prevent the text from being encoded with the GSM tables, as a list of
+     * objects with position and character properties, and a substitute property where the
+     * character has a replacement in the default GSM table */
+    Q_PROPERTY(QVariantList unsupportedCharacters READ unsupportedCharacters NOTIFY unsupportedCharactersChanged)
+    // The number of messages that would be required with the unsupported characters substituted
+    Q_PROPERTY(int reducedMessageCount READ reducedMessageCount NOTIFY unsupportedCharactersChanged)
+    // When set, unsupported characters are replaced by their substitutes in the text
+    Q_PROPERTY(bool reduce READ reduce WRITE setReduce NOTIFY reduceChanged)
+
+    /* The encodings that ofono would consider for the text in order of preference, of which the
+     * first that is viable is used; as a list of objects with encoding, lockingShift, viable and
+     * characterCount properties, where characterCount is -1 if the encoding is not viable */
+    Q_PROPERTY(QVariantList encodingCandidates READ encodingCandidates NOTIFY encodingCandidatesChanged)
+
+    /* The national language alphabet that ofono may fall back to, as configured by the
+     * ofono MessageManager 'Alphabet' property: "default", "turkish", "spanish" or "portuguese" */
+    Q_PROPERTY(QString alphabet READ alphabet WRITE setAlphabet NOTIFY alphabetChanged)
+
 public:
     SmsCharacterCounter(QObject *parent = 0);
+    ~SmsCharacterCounter();
+
+    /* Counts each of the texts with the current alphabet available, returning a list of objects with
+     * encoding ("default", "turkish", "spanish", "portuguese" or "ucs2"), messageCount and
+     * remainingCharacterCount properties */
+    Q_INVOKABLE QVariantList countTexts(const QStringList &texts) const;
+
+    /* Texts which replace a counter's text entirely are looked up in a cache of recent counts
+     * shared by all counters; these report its effectiveness */
+    static int cacheHitCount();
+    static int cacheMissCount();
+    static void clearCache();
 
     QString text() const;
     void setText(const QString &t);
 
+    /* Replaces removedLength characters at position in the text last supplied with inserted,
+     * without the caller supplying the entire text */
+    Q_INVOKABLE void applyEdit(int position, int removedLength, const QString &inserted);
+
+    QQuickTextDocument *document() const;
+    void setDocument(QQuickTextDocument *document);
+
+    QString alphabet() const;
+    void setAlphabet(const QString &alphabet);
+
     int messageCount() const;
     int remainingCharacterCount() const;
 
+    QList<int> segmentBoundaries() const;
+
+    int asynchronousThreshold() const;
+    void setAsynchronousThreshold(int threshold);
+
+    bool busy() const;
+
+    QVariantList unsupportedCharacters() const;
+    int reducedMessageCount() const;
+
+    bool reduce() const;
+    void setReduce(bool reduce);
+
+    QVariantList encodingCandidates() const;
+
+    /* Returns the length of the longest prefix of the text which can be sent in no more than
+     * segmentCount messages, in whichever encoding that prefix would use */
+    Q_INVOKABLE int truncatedLength(int segmentCount) const;
+
+    /* Returns the number of characters that can be added, in the current encoding, before the
+     * text requires more than segmentCount messages; this is negative if it already does */
+    Q_INVOKABLE int remainingCharacterCountWithin(int segmentCount) const;
+
 signals:
     void textChanged();
+    void documentChanged();
+    void alphabetChanged();
     void messageCountChanged();
     void remainingCharacterCountChanged();
+    void segmentBoundariesChanged();
+    void asynchronousThresholdChanged();
+    void busyChanged();
+    void unsupportedCharactersChanged();
+    void reduceChanged();
+    void encodingCandidatesChanged();
+
+private slots:
+    void documentContentsChange(int position, int charsRemoved, int charsAdded);
 
 private:
-    // Extension language sets are not supported by ofono
-    enum Encoding { Default, Spanish, Portuguese, Turkish, UCS2 };
+    struct CountCache;
 
-    void appendCharacter(const QChar &c);
-    void removeCharacter();
-    bool reencode(Encoding newEncoding);
+    void applyTextEdit(const SmsTextCounter::Edit &edit);
+    void publishCounts(bool textModified);
 
-    QString m_text;
+    void countAsynchronously(const QString &text, bool replacesText);
+    void cancelPendingCount();
+    void restartPendingCount();
+    void applyCount(const SmsTextCounter &counter);
+    void setBusy(bool busy);
+
+    static CountCache &countCache();
+    bool applyCachedCount(const QString &text);
+    void cacheCount(const SmsTextCounter &counter) const;
+
+    SmsTextCounter m_counter;
+    QPointer<QQuickTextDocument> m_document;
     int m_messageCount;
     int m_remainingCharacterCount;
-    int m_characterCount;
-    Encoding m_baseEncoding;
-    Encoding m_shiftEncoding;
-    const QVector<uint> *m_baseSet;
-    const QVector<uint> *m_shiftSet;
+    QList<int> m_segmentBoundaries;
+    int m_unsupportedCount;
+    QVector<SmsTextCounter::EncodingCandidate> m_encodingCandidates;
+    int m_asynchronousThreshold;
+    bool m_busy;
+    QSharedPointer<QAtomicInt> m_pendingCount;
+    QString m_pendingText;
+    bool m_pendingReplacesText;
 };
 
 #endif
-
@@ -0,0 +1,289 @@
+/* Copyright (C) 2015 Jolla Ltd
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "smsencoder.h"
+#include "smsalphabet.h"
+
+#include <QHash>
+#include <QtEndian>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace {
+
+using namespace SmsAlphabet;
+
+// The maximum length of TP-User-Data in octets
+const int userDataCapacity = 140;
+
+// Information element identifiers and national language identifiers from 3GPP TS 23.040
+const char concatenationElement = 0x00;
+const char singleShiftElement = 0x24;
+const char lockingShiftElement = 0x25;
+const char escapeCode = 0x1B;
+
+typedef QHash<ushort, char> CodeTable;
+
+template <std::size_t N>
+CodeTable baseCodeTable(const ushort (&chars)[N])
+{
+    CodeTable codes;
+    for (std::size_t i = 0; i < N; ++i) {
+        // The escape code has a placeholder character, which must not be encoded
+        if (i != std::size_t(escapeCode))
+            codes.insert(chars[i], char(i));
+    }
+    return codes;
+}
+
+template <std::size_t N>
+CodeTable shiftCodeTable(const ushort (&chars)[N], const quint8 (&codes)[N])
+{
+    CodeTable table;
+    for (std::size_t i = 0; i < N; ++i)
+        table.insert(chars[i], char(codes[i]));
+    return table;
+}
+
+const CodeTable &baseCodes(SmsTextCounter::Encoding encoding)
+{
+    static const CodeTable defaultCodes(baseCodeTable(defaultBaseChars));
+    static const CodeTable turkishCodes(baseCodeTable(turkishBaseChars));
+    static const CodeTable portugueseCodes(baseCodeTable(portugueseBaseChars));
+
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return turkishCodes;
+    case SmsTextCounter::Portuguese: return portugueseCodes;
+    default: return defaultCodes;
+    }
+}
+
+const CodeTable &shiftCodes(SmsTextCounter::Encoding encoding)
+{
+    static const CodeTable defaultCodes(shiftCodeTable(defaultShiftChars, defaultShiftCodes));
+    static const CodeTable turkishCodes(shiftCodeTable(turkishShiftChars, turkishShiftCodes));
+    static const CodeTable spanishCodes(shiftCodeTable(spanishShiftChars, spanishShiftCodes));
+    static const CodeTable portugueseCodes(shiftCodeTable(portugueseShiftChars, portugueseShiftCodes));
+
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return turkishCodes;
+    case SmsTextCounter::Spanish: return spanishCodes;
+    case SmsTextCounter::Portuguese: return portugueseCodes;
+    default: return defaultCodes;
+    }
+}
+
+char languageIdentifier(SmsTextCounter::Encoding encoding)
+{
+    switch (encoding) {
+    case SmsTextCounter::Turkish: return 0x01;
+    case SmsTextCounter::Spanish: return 0x02;
+    case SmsTextCounter::Portuguese: return 0x03;
+    default: return 0x00;
+    }
+}
+
+// Converts the text to septets, with each shift table character preceded by the escape code
+QByteArray encodeSeptets(const QString &text, SmsTextCounter::Encoding baseEncoding, SmsTextCounter::Encoding shiftEncoding)
+{
+    const CodeTable &base(baseCodes(baseEncoding));
+    const CodeTable &shift(shiftCodes(shiftEncoding));
+
+    QByteArray septets;
+    septets.reserve(text.length() * 2);
+    for (const QChar *it = text.constData(), *end = it + text.length(); it != end; ++it) {
+        CodeTable::const_iterator code = base.constFind(it->unicode());
+        if (code != base.constEnd()) {
+            septets.append(*code);
+        } else {
+            code = shift.constFind(it->unicode());
+            Q_ASSERT(code != shift.constEnd());
+            septets.append(escapeCode);
+            septets.append(*code);
+        }
+    }
+    return septets;
+}
+
+// Converts the text to big-endian UTF-16
+QByteArray encodeUcs2(const QString &text)
+{
+    QByteArray octets(text.length() * 2, Qt::Uninitialized);
+    for (int i = 0; i < text.length(); ++i)
+        qToBigEndian<quint16>(text.at(i).unicode(), reinterpret_cast<uchar *>(octets.data() + i * 2));
+    return octets;
+}
+
+QByteArray userDataHeader(SmsTextCounter::Encoding baseEncoding, SmsTextCounter::Encoding shiftEncoding, bool concatenated)
+{
+    QByteArray header;
+    if (concatenated) {
+        // The reference, count and sequence number are filled in for each segment
+        const char element[] = { concatenationElement, 3, 0, 0, 0 };
+        header.append(element, sizeof(element));
+    }
+    if (baseEncoding == SmsTextCounter::Turkish || baseEncoding == SmsTextCounter::Portuguese) {
+        const char element[] = { lockingShiftElement, 1, languageIdentifier(baseEncoding) };
+        header.append(element, sizeof(element));
+    }
+    if (shiftEncoding != SmsTextCounter::Default && shiftEncoding != SmsTextCounter::UCS2) {
+        const char element[] = { singleShiftElement, 1, languageIdentifier(shiftEncoding) };
+        header.append(element, sizeof(element));
+    }
+    if (!header.isEmpty())
+        header.prepend(char(header.length()));
+    return header;
+}
+
+/* Splits the encoded units into chunks of at most the given capacity, without separating an
+ * escape code from the character it shifts or a surrogate pair; returns the chunk lengths */
+QList<int> chunkLengths(const QByteArray &units, bool ucs2, int capacity)
+{
+    const int unitSize = ucs2 ? 2 : 1;
+    const int unitCount = units.length() / unitSize;
+
+    QList<int> lengths;
+    for (int position = 0; position < unitCount; ) {
+        int length = qMin(capacity, unitCount - position);
+        if (position + length < unitCount) {
+            const int last = position + length - 1;
+            if (ucs2) {
+                if (QChar::isHighSurrogate(qFromBigEndian<quint16>(reinterpret_cast<const uchar *>(units.constData() + last * 2))))
+                    --length;
+            } else if (units.at(last) == escapeCode) {
+                --length;
+            }
+        }
+        lengths.append(length);
+        position += length;
+    }
+    return lengths;
+}
+
+QList<int> chunkLengths(const QByteArray &units, bool ucs2, SmsTextCounter::Encoding baseEncoding,
+                        SmsTextCounter::Encoding shiftEncoding, QByteArray *header)
+{
+    for (int concatenated = 0; concatenated < 2; ++concatenated) {
+        *header = userDataHeader(baseEncoding, shiftEncoding, concatenated);
+        const int capacity = ucs2 ? (userDataCapacity - header->length()) / 2
+                                  : userDataCapacity * 8 / 7 - (header->length() * 8 + 6) / 7;
+
+        const QList<int> lengths(chunkLengths(units, ucs2, capacity));
+        if (concatenated || lengths.count() <= 1)
+            return lengths;
+    }
+    return QList<int>();
+}
+
+}
+
+SmsEncoder::Message SmsEncoder::encode(const QString &text, SmsTextCounter::Encoding alphabet, quint8 reference)
+{
+    const QString normalized(text.normalized(QString::NormalizationForm_KC));
+    const SmsTextCounter::TextCount count(SmsTextCounter::countText(normalized, alphabet));
+
+    Message message;
+    message.baseEncoding = count.baseEncoding;
+    message.shiftEncoding = count.shiftEncoding;
+
+    const bool ucs2 = count.baseEncoding == SmsTextCounter::UCS2;
+    const QByteArray units(ucs2 ? encodeUcs2(normalized) : encodeSeptets(normalized, count.baseEncoding, count.shiftEncoding));
+
+    QByteArray header;
+    const QList<int> lengths(chunkLengths(units, ucs2, count.baseEncoding, count.shiftEncoding, &header));
+    if (lengths.count() > 1) {
+        header[3] = char(reference);
+        header[4] = char(lengths.count());
+    }
+
+    // Septets following the header begin at the next septet boundary, after fill bits
+    const int headerSeptets = (header.length() * 8 + 6) / 7;
+
+    int position = 0;
+    for (int i = 0; i < lengths.count(); ++i) {
+        const int length = lengths.at(i);
+        if (lengths.count() > 1)
+            header[5] = char(i + 1);
+
+        Segment segment;
+        if (ucs2) {
+            segment.userData = header + units.mid(position * 2, length * 2);
+            segment.userDataLength = segment.userData.length();
+        } else {
+            segment.userDataLength = headerSeptets + length;
+            segment.userData = QByteArray((segment.userDataLength * 7 + 7) / 8, '\0');
+            std::copy(header.constBegin(), header.constEnd(), segment.userData.begin());
+            packSeptets(units.constData() + position, length, headerSeptets * 7, segment.userData.data());
+        }
+        message.segments.append(segment);
+        position += length;
+    }
+
+    return message;
+}
+
+void SmsEncoder::packSeptets(const char *septets, int count, int bitOffset, char *output)
+{
+    if (count <= 0)
+        return;
+
+    uchar *out = reinterpret_cast<uchar *>(output) + bitOffset / 8;
+    int pendingBits = bitOffset % 8;
+    quint64 pending = *out & ((1u << pendingBits) - 1);
+
+    /* Eight septets at a time are combined into seven octets, by merging adjacent fields in
+     * progressively wider lanes of a 64-bit word */
+    int i = 0;
+    for ( ; count - i >= 8; i += 8) {
+        quint64 word = qFromLittleEndian<quint64>(reinterpret_cast<const uchar *>(septets + i));
+        word = (word & Q_UINT64_C(0x007F007F007F007F)) | ((word & Q_UINT64_C(0x7F007F007F007F00)) >> 1);
+        word = (word & Q_UINT64_C(0x00003FFF00003FFF)) | ((word & Q_UINT64_C(0x3FFF00003FFF0000)) >> 2);
+        word = (word & Q_UINT64_C(0x000000000FFFFFFF)) | ((word & Q_UINT64_C(0x0FFFFFFF00000000)) >> 4);
+
+        pending |= word << pendingBits;
+        for (int j = 0; j < 7; ++j) {
+            *out++ = uchar(pending);
+            pending >>= 8;
+        }
+    }
+
+    for ( ; i < count; ++i) {
+        pending |= quint64(septets[i] & 0x7F) << pendingBits;
+        pendingBits += 7;
+        if (pendingBits >= 8) {
+            *out++ = uchar(pending);
+            pending >>= 8;
+            pendingBits -= 8;
+        }
+    }
+    if (pendingBits)
+        *out = uchar(pending);
+}
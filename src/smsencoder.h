@@ -0,0 +1,69 @@
+/* Copyright (C) 2015 Jolla Ltd
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMSENCODER_H
+#define SMSENCODER_H
+
+#include "smstextcounter.h"
+
+#include <QByteArray>
+#include <QList>
+#include <QString>
+
+/* Encodes message text into the TP-User-Data of one or more SMS PDUs, with the same encoding and
+ * segmentation that SmsTextCounter reports for the text */
+class SmsEncoder
+{
+public:
+    struct Segment
+    {
+        // The user data header (if any) followed by the packed septets or UCS-2 octets
+        QByteArray userData;
+        // TP-UDL: the length of the user data in septets for GSM encodings, or in octets for UCS-2
+        int userDataLength;
+    };
+
+    struct Message
+    {
+        SmsTextCounter::Encoding baseEncoding;
+        SmsTextCounter::Encoding shiftEncoding;
+        QList<Segment> segments;
+    };
+
+    /* Encodes the text with the given alphabet available, identifying the segments of a
+     * concatenated message with the reference number */
+    static Message encode(const QString &text, SmsTextCounter::Encoding alphabet, quint8 reference = 0);
+
+    /* Packs septets into the output, starting at a bit offset which is a multiple of seven; the
+     * output must hold (bitOffset + count * 7 + 7) / 8 bytes, with those past the offset zeroed */
+    static void packSeptets(const char *septets, int count, int bitOffset, char *output);
+};
+
+#endif
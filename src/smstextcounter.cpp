@@ -0,0 +1,1161 @@
+/* Copyright (C) 2015 Jolla Ltd
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "smstextcounter.h"
+#include "smsalphabet.h"
+
+#include <QChar>
+#include <QtConcurrent>
+
+#include <algorithm>
+#include <cstddef>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+namespace {
+
+using namespace SmsAlphabet;
+
+// Most text consists of ASCII letters, digits, spaces and punctuation that are in the base table of
+// every dialect; these characters all have the same membership, so runs of them can be counted
+// without classifying each character
+constexpr quint8 plainMembership = computeMembership(0x0061);
+
+constexpr bool rangeHasMembership(ushort first, ushort last, quint8 membership)
+{
+    return first > last ? true : (computeMembership(first) == membership && rangeHasMembership(first + 1, last, membership));
+}
+
+static_assert(rangeHasMembership(0x0020, 0x005A, plainMembership) && rangeHasMembership(0x0061, 0x007A, plainMembership),
+              "Plain character ranges do not share the same table membership");
+
+// Counting a whole text is divided into blocks, so that a cancelled count is abandoned promptly
+const int countBlockSize = 4096;
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+const int plainBlockSize = 8;
+
+// Tests whether all of the eight characters at the given position are in the plain ranges
+inline bool isPlainBlock(const QChar *it)
+{
+#if defined(__SSE2__)
+    // There is no unsigned 16-bit comparison; a saturating subtraction of the range size from the
+    // offset into the range yields zero for characters within the range
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(it));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i upper = _mm_subs_epu16(_mm_sub_epi16(v, _mm_set1_epi16(0x0020)), _mm_set1_epi16(0x005A - 0x0020));
+    const __m128i lower = _mm_subs_epu16(_mm_sub_epi16(v, _mm_set1_epi16(0x0061)), _mm_set1_epi16(0x007A - 0x0061));
+    const __m128i plain = _mm_or_si128(_mm_cmpeq_epi16(upper, zero), _mm_cmpeq_epi16(lower, zero));
+    return _mm_movemask_epi8(plain) == 0xFFFF;
+#else
+    const uint16x8_t v = vld1q_u16(reinterpret_cast<const uint16_t *>(it));
+    const uint16x8_t upper = vcleq_u16(vsubq_u16(v, vdupq_n_u16(0x0020)), vdupq_n_u16(0x005A - 0x0020));
+    const uint16x8_t lower = vcleq_u16(vsubq_u16(v, vdupq_n_u16(0x0061)), vdupq_n_u16(0x007A - 0x0061));
+    const uint16x8_t plain = vorrq_u16(upper, lower);
+    const uint16x4_t folded = vand_u16(vget_low_u16(plain), vget_high_u16(plain));
+    return vget_lane_u64(vreinterpret_u64_u16(folded), 0) == ~Q_UINT64_C(0);
+#endif
+}
+#endif
+
+// Returns the tables that ofono may use for a text when the given alphabet is configured
+quint8 alphabetTables(SmsTextCounter::Encoding alphabet)
+{
+    quint8 tables(DefaultBaseTable | DefaultShiftTable);
+    if (alphabet != SmsTextCounter::Default) {
+        tables |= shiftTable(alphabet);
+        if (alphabet != SmsTextCounter::Spanish)
+            tables |= baseTable(alphabet);
+    }
+    return tables;
+}
+
+struct Substitution {
+    ushort character;
+    ushort replacement[4];
+};
+
+// Replacements in the default base table for common characters that are not in it; these are
+// mostly typographic punctuation, and accented letters that are in some national tables only.
+// Characters that NFKC normalization replaces are not needed here.
+constexpr Substitution substitutions[] = {
+    { 0x00AB, { 0x0022 } },
+    { 0x00AD, { } },
+    { 0x00B7, { 0x002E } },
+    { 0x00BB, { 0x0022 } },
+    { 0x00C0, { 0x0041 } },
+    { 0x00C1, { 0x0041 } },
+    { 0x00C2, { 0x0041 } },
+    { 0x00C3, { 0x0041 } },
+    { 0x00C8, { 0x0045 } },
+    { 0x00CA, { 0x0045 } },
+    { 0x00CB, { 0x0045 } },
+    { 0x00CC, { 0x0049 } },
+    { 0x00CD, { 0x0049 } },
+    { 0x00CE, { 0x0049 } },
+    { 0x00CF, { 0x0049 } },
+    { 0x00D2, { 0x004F } },
+    { 0x00D3, { 0x004F } },
+    { 0x00D4, { 0x004F } },
+    { 0x00D5, { 0x004F } },
+    { 0x00D7, { 0x0078 } },
+    { 0x00D9, { 0x0055 } },
+    { 0x00DA, { 0x0055 } },
+    { 0x00DB, { 0x0055 } },
+    { 0x00DD, { 0x0059 } },
+    { 0x00E1, { 0x0061 } },
+    { 0x00E2, { 0x0061 } },
+    { 0x00E3, { 0x0061 } },
+    { 0x00E7, { 0x00C7 } },
+    { 0x00EA, { 0x0065 } },
+    { 0x00EB, { 0x0065 } },
+    { 0x00ED, { 0x0069 } },
+    { 0x00EE, { 0x0069 } },
+    { 0x00EF, { 0x0069 } },
+    { 0x00F3, { 0x006F } },
+    { 0x00F4, { 0x006F } },
+    { 0x00F5, { 0x006F } },
+    { 0x00F7, { 0x002F } },
+    { 0x00FA, { 0x0075 } },
+    { 0x00FB, { 0x0075 } },
+    { 0x00FD, { 0x0079 } },
+    { 0x00FF, { 0x0079 } },
+    { 0x011E, { 0x0047 } },
+    { 0x011F, { 0x0067 } },
+    { 0x0130, { 0x0049 } },
+    { 0x0131, { 0x0069 } },
+    { 0x015E, { 0x0053 } },
+    { 0x015F, { 0x0073 } },
+    { 0x200B, { } },
+    { 0x2010, { 0x002D } },
+    { 0x2012, { 0x002D } },
+    { 0x2013, { 0x002D } },
+    { 0x2014, { 0x002D } },
+    { 0x2015, { 0x002D } },
+    { 0x2018, { 0x0027 } },
+    { 0x2019, { 0x0027 } },
+    { 0x201A, { 0x0027 } },
+    { 0x201B, { 0x0027 } },
+    { 0x201C, { 0x0022 } },
+    { 0x201D, { 0x0022 } },
+    { 0x201E, { 0x0022 } },
+    { 0x201F, { 0x0022 } },
+    { 0x2022, { 0x002A } },
+    { 0x2032, { 0x0027 } },
+    { 0x2039, { 0x0027 } },
+    { 0x203A, { 0x0027 } },
+    { 0x2212, { 0x002D } },
+    { 0xFEFF, { } },
+};
+
+template <std::size_t N>
+constexpr bool substitutionsValid(const Substitution (&table)[N], std::size_t i = 0, std::size_t j = 0)
+{
+    return i == N ? true
+         : (table[i].replacement[j] == 0 ? ((i == 0 || table[i - 1].character < table[i].character) && substitutionsValid(table, i + 1, 0))
+                                         : ((computeMembership(table[i].replacement[j]) & DefaultBaseTable) && substitutionsValid(table, i, j + 1)));
+}
+
+static_assert(substitutionsValid(substitutions), "Substitutions must be ordered, and replaced with default base table characters");
+
+// Returns the replacement for a character, or null if it has none
+const Substitution *findSubstitution(const QChar &c)
+{
+    const Substitution *end = substitutions + sizeof(substitutions) / sizeof(substitutions[0]);
+    const Substitution *it = std::lower_bound(substitutions, end, c.unicode(),
+                                              [](const Substitution &substitution, ushort character) { return substitution.character < character; });
+    return (it != end && it->character == c.unicode()) ? it : 0;
+}
+
+// Replaces the characters that cannot be represented with the given alphabet, where possible
+QString substituteCharacters(const QString &text, SmsTextCounter::Encoding alphabet)
+{
+    const quint8 tables(alphabetTables(alphabet));
+
+    QString result;
+    int copied = 0;
+    for (int i = 0; i < text.length(); ++i) {
+        if (tableMembership(text.at(i)) & tables)
+            continue;
+
+        if (const Substitution *substitution = findSubstitution(text.at(i))) {
+            result.append(text.constData() + copied, i - copied);
+            for (const ushort *it = substitution->replacement; *it; ++it)
+                result.append(QChar(*it));
+            copied = i + 1;
+        }
+    }
+
+    if (!copied)
+        return text;
+
+    result.append(text.constData() + copied, text.length() - copied);
+    return result;
+}
+
+int commonPrefixLength(const QString &lhs, const QString &rhs)
+{
+    const QChar *l = lhs.constData(), *r = rhs.constData();
+    const QChar *end = l + qMin(lhs.length(), rhs.length());
+    const QChar *it = l;
+    for ( ; it != end && *it == *r; ++it, ++r)
+        ;
+    return it - l;
+}
+
+int commonSuffixLength(const QString &lhs, const QString &rhs, int limit)
+{
+    const QChar *l = lhs.constData() + lhs.length(), *r = rhs.constData() + rhs.length();
+    const QChar *end = l - limit;
+    const QChar *it = l;
+    for ( ; it != end && *(it - 1) == *(r - 1); --it, --r)
+        ;
+    return l - it;
+}
+
+// NFKC normalization does not alter these characters, but it may combine one with a following
+// character, as it does "e" with U+0301; only between two of them is there a boundary across
+// which the text on either side is normalized independently
+inline bool isNormalizationInert(const QChar &c)
+{
+    const ushort u(c.unicode());
+    return u < 0x80 || (u >= 0x4E00 && u <= 0x9FFF);
+}
+
+bool isNormalizationStable(const QChar *it, int length)
+{
+    for (const QChar *end = it + length; it != end; ++it) {
+        if (!isNormalizationInert(*it))
+            return false;
+    }
+    return true;
+}
+
+void countMemberships(const QChar *it, int length, int delta, int *membershipCounts)
+{
+    const QChar *end = it + length;
+
+#if defined(__SSE2__) || defined(__ARM_NEON) || defined(__ARM_NEON__)
+    // Count blocks of plain characters together, and only classify the characters of other blocks
+    int plainCount = 0;
+    for ( ; end - it >= plainBlockSize; it += plainBlockSize) {
+        if (isPlainBlock(it)) {
+            plainCount += plainBlockSize;
+        } else {
+            for (const QChar *c = it, *blockEnd = it + plainBlockSize; c != blockEnd; ++c) {
+                membershipCounts[tableMembership(*c)] += delta;
+            }
+        }
+    }
+    membershipCounts[plainMembership] += plainCount * delta;
+#endif
+
+    for ( ; it != end; ++it) {
+        membershipCounts[tableMembership(*it)] += delta;
+    }
+}
+
+// The encodings that ofono tries, in order: the default tables, then the national language single
+// shift table alone, and then with the national language locking shift table, and finally UCS-2
+enum Candidate { DefaultCandidate, SingleShiftCandidate, LockingShiftCandidate, UCS2Candidate };
+
+static_assert(UCS2Candidate + 1 == int(SmsTextCounter::CandidateCount), "Each candidate encoding must be measured");
+
+void candidateEncoding(int candidate, SmsTextCounter::Encoding alphabet,
+                       SmsTextCounter::Encoding *baseEncoding, SmsTextCounter::Encoding *shiftEncoding)
+{
+    *baseEncoding = candidate == UCS2Candidate ? SmsTextCounter::UCS2 : (candidate == LockingShiftCandidate ? alphabet : SmsTextCounter::Default);
+    *shiftEncoding = (candidate == SingleShiftCandidate || candidate == LockingShiftCandidate) ? alphabet : SmsTextCounter::Default;
+}
+
+// The national language candidates are only available with a national language alphabet, and
+// Spanish has no locking shift table
+quint8 availableCandidates(SmsTextCounter::Encoding alphabet)
+{
+    quint8 available = (1 << DefaultCandidate) | (1 << UCS2Candidate);
+    if (alphabet != SmsTextCounter::Default)
+        available |= 1 << SingleShiftCandidate;
+    if (alphabet != SmsTextCounter::Default && alphabet != SmsTextCounter::Spanish)
+        available |= 1 << LockingShiftCandidate;
+    return available;
+}
+
+/* Measures the counted characters under every candidate encoding together, in a single pass over
+ * the membership counts; returns the mask of candidates able to represent all of them, whose
+ * lengths are the number of septets (or UCS-2 code units) required, and -1 for the others */
+quint8 measureCandidates(const int *membershipCounts, int length, SmsTextCounter::Encoding alphabet, int *lengths)
+{
+    quint8 viable = availableCandidates(alphabet);
+
+    quint8 baseTables[UCS2Candidate], shiftTables[UCS2Candidate];
+    for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+        SmsTextCounter::Encoding baseEncoding, shiftEncoding;
+        candidateEncoding(candidate, alphabet, &baseEncoding, &shiftEncoding);
+        baseTables[candidate] = baseTable(baseEncoding);
+        shiftTables[candidate] = shiftTable(shiftEncoding);
+        lengths[candidate] = 0;
+    }
+    lengths[UCS2Candidate] = length;
+
+    // Once only UCS-2 remains, the other counts are irrelevant
+    for (int membership = 0; membership < SmsTextCounter::MembershipCount && viable != (1 << UCS2Candidate); ++membership) {
+        const int count = membershipCounts[membership];
+        if (!count)
+            continue;
+
+        for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+            if (!(viable & (1 << candidate))) {
+                continue;
+            } else if (membership & baseTables[candidate]) {
+                lengths[candidate] += count;
+            } else if (membership & shiftTables[candidate]) {
+                // Shift table characters require an escape sequence
+                lengths[candidate] += 2 * count;
+            } else {
+                // This text is not representable in this encoding
+                viable &= ~(1 << candidate);
+            }
+        }
+    }
+
+    for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+        if (!(viable & (1 << candidate)))
+            lengths[candidate] = -1;
+    }
+    return viable;
+}
+
+// Returns the first viable candidate, which is the one ofono will use
+int preferredCandidate(quint8 viable)
+{
+    int candidate = 0;
+    for ( ; !(viable & (1 << candidate)); ++candidate)
+        ;
+    return candidate;
+}
+
+// Returns the number of characters available in a single message, or in each part of a concatenated message
+int segmentCapacity(SmsTextCounter::Encoding baseEncoding, SmsTextCounter::Encoding shiftEncoding, bool concatenated)
+{
+    // If we encode with alternate character sets, we must include that information in the header
+    const int overheadFromBaseEncoding = (baseEncoding == SmsTextCounter::Default || baseEncoding == SmsTextCounter::UCS2) ? 0 : 3;
+    const int overheadFromShiftEncoding = shiftEncoding == SmsTextCounter::Default ? 0 : 3;
+    const int overheadFromEncoding = overheadFromBaseEncoding + overheadFromShiftEncoding;
+
+    // A single SMS allows 140 bytes (160 septets), for both data and header
+    const int maxSegmentBytes = 140;
+
+    // UCS2 requires 16 bits per character, all other encodings require 7 bits
+    const int bitsPerCharacter(baseEncoding == SmsTextCounter::UCS2 ? 16 : 7);
+
+    // If the header is required, 1 additional byte is needed for the header length field
+    int overhead(overheadFromEncoding ? overheadFromEncoding + 1 : 0);
+
+    if (concatenated) {
+        // We must allocate 5 additional header bytes for each packet's segmentation framing
+        // Note: ofono does not currently use the 16-bit segmentation count option
+        overhead += (overhead ? 5 : 6);
+    }
+
+    return ((maxSegmentBytes - overhead) * 8) / bitsPerCharacter;
+}
+
+// Returns the start of the segment following the one starting at position, or the length of the text
+// if that segment is the last, and stores the number of characters in the segment in count. Like ofono,
+// we do not separate an escape from its shift table character, or the halves of a surrogate pair
+int nextSegmentStart(const QChar *text, int length, int position, SmsTextCounter::Encoding baseEncoding, int capacity, int *count)
+{
+    const quint8 encodingBaseTable(baseTable(baseEncoding));
+
+    int used = 0;
+    while (position < length) {
+        int width = 1, cost = 1;
+        if (baseEncoding == SmsTextCounter::UCS2) {
+            if (text[position].isHighSurrogate() && position + 1 < length && text[position + 1].isLowSurrogate())
+                width = cost = 2;
+        } else if (!(tableMembership(text[position]) & encodingBaseTable)) {
+            // Shift table characters require an escape sequence
+            cost = 2;
+        }
+
+        if (used + cost > capacity)
+            break;
+
+        used += cost;
+        position += width;
+    }
+
+    *count = used;
+    return position;
+}
+
+}
+
+bool SmsTextCounter::EncodingCandidate::operator==(const EncodingCandidate &other) const
+{
+    return baseEncoding == other.baseEncoding && shiftEncoding == other.shiftEncoding
+            && viable == other.viable && characterCount == other.characterCount;
+}
+
+SmsTextCounter::SmsTextCounter(Encoding alphabet, bool reduce)
+    : m_alphabet(alphabet)
+    , m_reduce(reduce)
+    , m_cancelled(0)
+    , m_characterCount(0)
+    , m_baseEncoding(Default)
+    , m_shiftEncoding(Default)
+    , m_segmentBaseEncoding(Default)
+    , m_segmentShiftEncoding(Default)
+    , m_capacity(0)
+    , m_lastSegmentCount(0)
+    , m_membershipCounts()
+    , m_candidateLengths()
+    , m_viableCandidates(0)
+    , m_unsupportedCount(0)
+    , m_firstUnrepresentable()
+    , m_prefixCostsValid(1)
+    , m_reductionValid(true)
+    , m_reducedMessageCount(0)
+{
+    selectEncoding();
+}
+
+SmsTextCounter::TextCount SmsTextCounter::countText(const QString &text, Encoding alphabet)
+{
+    SmsTextCounter counter(alphabet);
+    counter.setText(text);
+
+    const TextCount result = { counter.m_baseEncoding, counter.m_shiftEncoding, counter.messageCount(), counter.remainingCharacterCount() };
+    return result;
+}
+
+QVector<SmsTextCounter::TextCount> SmsTextCounter::countTexts(const QStringList &texts, Encoding alphabet)
+{
+    QVector<TextCount> results(texts.count());
+    TextCount *data = results.data();
+
+    // Small batches are counted directly; larger batches are divided between the threads
+    // of the global thread pool
+    const int batchSize = 32;
+    if (texts.count() <= batchSize) {
+        for (int i = 0; i < texts.count(); ++i) {
+            data[i] = countText(texts.at(i), alphabet);
+        }
+    } else {
+        QVector<int> batches;
+        for (int i = 0; i < texts.count(); i += batchSize) {
+            batches.append(i);
+        }
+
+        QtConcurrent::blockingMap(batches, [&texts, alphabet, data](int first) {
+            for (int i = first, end = qMin(first + batchSize, texts.count()); i < end; ++i) {
+                data[i] = countText(texts.at(i), alphabet);
+            }
+        });
+    }
+
+    return results;
+}
+
+QString SmsTextCounter::text() const
+{
+    return m_text;
+}
+
+QString SmsTextCounter::sourceText() const
+{
+    return m_sourceSpans.isEmpty() ? m_text : m_sourceText;
+}
+
+bool SmsTextCounter::setText(const QString &text)
+{
+    return applyEdit(textEdit(text));
+}
+
+bool SmsTextCounter::applyEdit(int position, int removedLength, const QString &inserted)
+{
+    return applyEdit(textEdit(position, removedLength, inserted));
+}
+
+SmsTextCounter::Edit SmsTextCounter::textEdit(const QString &text) const
+{
+    // We need to determine how this string will be encoded into SMS by ofono;
+    // the relevant function is sms_text_prepare_with_alphabet() in smsutil.c
+
+    // Ofono will encode the text using the first possible from:
+    // a) the default GSM 03.38 7-bit dialect
+    // b) the dialect corresponding to the ofono 'sms/Alphabet' setting value
+    //    (note: ofono tries first with single shift, then with both single and locking shift)
+    // c) UCS-2 encoding
+
+    // The 'sms/Alphabet' setting is exposed by ofono as the MessageManager 'Alphabet'
+    // property; it must be supplied to us as our alphabet, otherwise only the default
+    // dialect is considered and the estimate may be pessimistic.
+
+    // Find the span of the text as supplied that has been modified, and apply it as an edit
+    const QString source(sourceText());
+    const int prefixLength = commonPrefixLength(source, text);
+    const int suffixLength = (prefixLength == source.length() && prefixLength == text.length())
+            ? 0 : commonSuffixLength(source, text, qMin(source.length(), text.length()) - prefixLength);
+
+    Edit edit(textEdit(prefixLength, source.length() - prefixLength - suffixLength,
+                       text.mid(prefixLength, text.length() - prefixLength - suffixLength)));
+    edit.source = text;
+    edit.replacesText = prefixLength == 0 && suffixLength == 0 && !text.isEmpty();
+    return edit;
+}
+
+SmsTextCounter::Edit SmsTextCounter::textEdit(int position, int removedLength, const QString &inserted) const
+{
+    if (!removedLength && inserted.isEmpty()) {
+        const Edit edit = { 0, 0, 0, 0, QString(), QString(), false };
+        return edit;
+    }
+
+    // Edits refer to the text as supplied, which is identical to ours outside its differing spans
+    const QString &source(m_sourceSpans.isEmpty() ? m_text : m_sourceText);
+    const int length = source.length();
+    const int editEnd = position + removedLength;
+    const bool replacesText(position == 0 && removedLength == length);
+
+    // Extend the edit to the nearest characters that normalization cannot affect; the character
+    // following the edit is the first inserted, or else the first remaining. Where the extended
+    // span overlaps a span differing from our text, it is extended to include all of that span
+    const QChar *following = !inserted.isEmpty() ? inserted.constData() : editEnd < length ? source.constData() + editEnd : 0;
+
+    const bool boundary(position < length && following && isNormalizationInert(source.at(position)) && isNormalizationInert(*following));
+    int spanStart = boundary ? position : qMax(position - 1, 0);
+    for (int start = -1; start != spanStart; ) {
+        for ( ; spanStart > 0 && !isNormalizationInert(source.at(spanStart)); --spanStart)
+            ;
+        start = spanStart;
+        spanStart = containingSpanStart(spanStart);
+    }
+
+    int spanEnd = editEnd;
+    for (int end = -1; end != spanEnd; ) {
+        for ( ; spanEnd < length && !isNormalizationInert(source.at(spanEnd)); ++spanEnd)
+            ;
+        end = spanEnd;
+        spanEnd = containingSpanEnd(spanEnd);
+    }
+
+    const int textStart = textPosition(spanStart);
+    const Edit edit = {
+        textStart,
+        textPosition(spanEnd) - textStart,
+        spanStart,
+        spanEnd - spanStart,
+        source.mid(spanStart, position - spanStart) + inserted + source.mid(editEnd, spanEnd - editEnd),
+        replacesText ? inserted : QString(),
+        replacesText && !inserted.isEmpty()
+    };
+    return edit;
+}
+
+bool SmsTextCounter::applyEdit(const Edit &edit)
+{
+    // Ensure that our string is fully normalized
+    QString inserted(edit.span);
+    if (!isNormalizationStable(inserted.constData(), inserted.length()))
+        inserted = inserted.normalized(QString::NormalizationForm_KC);
+    if (m_reduce)
+        inserted = substituteCharacters(inserted, m_alphabet);
+
+    const bool modified(inserted.length() != edit.removedLength
+            || !std::equal(inserted.constData(), inserted.constData() + edit.removedLength, m_text.constData() + edit.position));
+
+    // Our text differs from the text as supplied only within the spans recorded; the supplied
+    // text is kept only when it is needed to interpret later edits
+    updateSourceSpans(edit, inserted);
+
+    if (modified) {
+        if (m_text.isEmpty()) {
+            restart(inserted);
+        } else {
+            // Only the modified span needs to be counted again
+            replaceText(edit.position, edit.removedLength, inserted);
+        }
+        selectEncoding();
+        updateCounts(edit.position, edit.removedLength, inserted.length());
+    }
+
+    return modified;
+}
+
+QString SmsTextCounter::editedText(const Edit &edit) const
+{
+    return !edit.source.isNull() ? edit.source : sourceText().replace(edit.sourcePosition, edit.sourceRemovedLength, edit.span);
+}
+
+// Returns the position in our text corresponding to a position in the text as supplied, which
+// must not be within a differing span
+int SmsTextCounter::textPosition(int sourcePosition) const
+{
+    // Find the last span ending at or before the position
+    QVector<SourceSpan>::const_iterator it = std::upper_bound(m_sourceSpans.constBegin(), m_sourceSpans.constEnd(), sourcePosition,
+            [](int position, const SourceSpan &span) { return position < span.sourcePosition + span.sourceLength; });
+    if (it == m_sourceSpans.constBegin())
+        return sourcePosition;
+
+    --it;
+    return (*it).position + (*it).length + sourcePosition - (*it).sourcePosition - (*it).sourceLength;
+}
+
+// Returns the start of the differing span containing the position, or the position itself if
+// it is not within one
+int SmsTextCounter::containingSpanStart(int sourcePosition) const
+{
+    QVector<SourceSpan>::const_iterator it = std::upper_bound(m_sourceSpans.constBegin(), m_sourceSpans.constEnd(), sourcePosition,
+            [](int position, const SourceSpan &span) { return position < span.sourcePosition + span.sourceLength; });
+    return (it != m_sourceSpans.constEnd() && (*it).sourcePosition < sourcePosition) ? (*it).sourcePosition : sourcePosition;
+}
+
+// Returns the end of the differing span containing the position, or the position itself if it
+// is not within one
+int SmsTextCounter::containingSpanEnd(int sourcePosition) const
+{
+    QVector<SourceSpan>::const_iterator it = std::upper_bound(m_sourceSpans.constBegin(), m_sourceSpans.constEnd(), sourcePosition,
+            [](int position, const SourceSpan &span) { return position < span.sourcePosition + span.sourceLength; });
+    return (it != m_sourceSpans.constEnd() && (*it).sourcePosition < sourcePosition) ? (*it).sourcePosition + (*it).sourceLength : sourcePosition;
+}
+
+void SmsTextCounter::updateSourceSpans(const Edit &edit, const QString &inserted)
+{
+    const bool sourceDiffered(!m_sourceSpans.isEmpty());
+
+    // The spans within the edit are replaced by those differing in its replacement
+    QVector<SourceSpan> spans;
+    if (inserted != edit.span) {
+        // The replacement is normalized independently in pieces, each of which starts with a
+        // character that normalization cannot affect; those characters are never substituted
+        const int spanLength = edit.span.length();
+        int position = 0;
+        int textPosition = 0;
+        while (position < spanLength) {
+            int end = position + 1;
+            for ( ; end < spanLength && !isNormalizationInert(edit.span.at(end)); ++end)
+                ;
+
+            if (end - position == 1 && isNormalizationInert(edit.span.at(position))) {
+                ++position;
+                ++textPosition;
+                continue;
+            }
+
+            QString piece(edit.span.mid(position, end - position));
+            QString counted(piece.normalized(QString::NormalizationForm_KC));
+            if (m_reduce)
+                counted = substituteCharacters(counted, m_alphabet);
+
+            if (counted != piece) {
+                // Adjacent differing pieces are recorded together
+                if (!spans.isEmpty() && spans.last().sourcePosition + spans.last().sourceLength == edit.sourcePosition + position) {
+                    spans.last().sourceLength += end - position;
+                    spans.last().length += counted.length();
+                } else {
+                    const SourceSpan span = { edit.sourcePosition + position, end - position, edit.position + textPosition, counted.length() };
+                    spans.append(span);
+                }
+            }
+
+            position = end;
+            textPosition += counted.length();
+        }
+        Q_ASSERT(textPosition == inserted.length());
+    }
+
+    const int sourceEnd = edit.sourcePosition + edit.sourceRemovedLength;
+    QVector<SourceSpan>::iterator first = std::lower_bound(m_sourceSpans.begin(), m_sourceSpans.end(), edit.sourcePosition,
+            [](const SourceSpan &span, int position) { return span.sourcePosition < position; });
+    QVector<SourceSpan>::iterator last = std::lower_bound(first, m_sourceSpans.end(), sourceEnd,
+            [](const SourceSpan &span, int position) { return span.sourcePosition < position; });
+    if (first != last || !spans.isEmpty() || edit.span.length() != edit.sourceRemovedLength || inserted.length() != edit.removedLength) {
+        // Spans following the edit are displaced by it
+        const int sourceDelta = edit.span.length() - edit.sourceRemovedLength;
+        const int delta = inserted.length() - edit.removedLength;
+        for (QVector<SourceSpan>::iterator it = last; it != m_sourceSpans.end(); ++it) {
+            (*it).sourcePosition += sourceDelta;
+            (*it).position += delta;
+        }
+
+        const int index = first - m_sourceSpans.begin();
+        m_sourceSpans.erase(first, last);
+        for (int i = 0; i < spans.count(); ++i)
+            m_sourceSpans.insert(index + i, spans.at(i));
+    }
+
+    if (m_sourceSpans.isEmpty()) {
+        m_sourceText.clear();
+    } else if (!edit.source.isNull()) {
+        m_sourceText = edit.source;
+    } else if (sourceDiffered) {
+        m_sourceText.replace(edit.sourcePosition, edit.sourceRemovedLength, edit.span);
+    } else {
+        // Our text has not yet been modified, and was the text as supplied until now
+        m_sourceText = QString(m_text).replace(edit.position, edit.removedLength, edit.span);
+    }
+}
+
+void SmsTextCounter::setCancellation(const QAtomicInt *cancelled)
+{
+    m_cancelled = cancelled;
+}
+
+SmsTextCounter::Encoding SmsTextCounter::alphabet() const
+{
+    return m_alphabet;
+}
+
+bool SmsTextCounter::setAlphabet(Encoding alphabet)
+{
+    if (m_alphabet == alphabet)
+        return false;
+
+    m_alphabet = alphabet;
+    m_prefixCostsValid = 1;
+
+    // The alternatives available for our existing text have changed
+    selectEncoding();
+    updateCounts(m_text.length(), 0, 0);
+
+    // The characters requiring substitution depend upon the alphabet, so any we substituted
+    // are substituted again from the text as supplied
+    if (m_reduce && (!m_sourceSpans.isEmpty() || m_unsupportedCount))
+        return recountSource();
+    return false;
+}
+
+bool SmsTextCounter::reduce() const
+{
+    return m_reduce;
+}
+
+bool SmsTextCounter::setReduce(bool reduce)
+{
+    if (m_reduce == reduce)
+        return false;
+
+    // Substitute any unsupported characters we already have, or restore those we substituted
+    m_reduce = reduce;
+    if (m_reduce ? !m_unsupportedCount : m_sourceSpans.isEmpty())
+        return false;
+
+    return recountSource();
+}
+
+// Counts the text as supplied again, substituting its unsupported characters if reducing;
+// returns whether the counted text was modified
+bool SmsTextCounter::recountSource()
+{
+    const QString source(sourceText());
+    const Edit edit = { 0, m_text.length(), 0, source.length(), source, source, false };
+    return applyEdit(edit);
+}
+
+SmsTextCounter::Encoding SmsTextCounter::baseEncoding() const
+{
+    return m_baseEncoding;
+}
+
+SmsTextCounter::Encoding SmsTextCounter::shiftEncoding() const
+{
+    return m_shiftEncoding;
+}
+
+int SmsTextCounter::characterCount() const
+{
+    return m_characterCount;
+}
+
+int SmsTextCounter::messageCount() const
+{
+    return m_characterCount ? m_segmentBoundaries.count() + 1 : 0;
+}
+
+int SmsTextCounter::remainingCharacterCount() const
+{
+    return m_characterCount ? m_capacity - m_lastSegmentCount : 0;
+}
+
+QList<int> SmsTextCounter::segmentBoundaries() const
+{
+    return m_segmentBoundaries;
+}
+
+QVector<SmsTextCounter::EncodingCandidate> SmsTextCounter::encodingCandidates() const
+{
+    const quint8 available(availableCandidates(m_alphabet));
+
+    QVector<EncodingCandidate> candidates;
+    for (int candidate = 0; candidate < CandidateCount; ++candidate) {
+        if (!(available & (1 << candidate)))
+            continue;
+
+        EncodingCandidate result;
+        candidateEncoding(candidate, m_alphabet, &result.baseEncoding, &result.shiftEncoding);
+        result.lockingShift = candidate == LockingShiftCandidate;
+        result.viable = m_viableCandidates & (1 << candidate);
+        result.characterCount = m_candidateLengths[candidate];
+        candidates.append(result);
+    }
+    return candidates;
+}
+
+int SmsTextCounter::unsupportedCount() const
+{
+    return m_unsupportedCount;
+}
+
+QList<SmsTextCounter::UnsupportedCharacter> SmsTextCounter::unsupportedCharacters() const
+{
+    updateReduction();
+    return m_unsupportedCharacters;
+}
+
+int SmsTextCounter::reducedMessageCount() const
+{
+    if (!m_unsupportedCount)
+        return messageCount();
+
+    updateReduction();
+    return m_reducedMessageCount;
+}
+
+int SmsTextCounter::truncatedLength(int segmentCount) const
+{
+    if (segmentCount <= 0)
+        return 0;
+    if (messageCount() <= segmentCount)
+        return m_text.length();
+
+    updatePrefixCosts();
+
+    /* A prefix is encoded with the first candidate able to represent it, so each candidate
+     * encodes the prefixes longer than those the preceding candidates can represent, and no
+     * longer than those it can represent itself; within that range, the longer prefixes that
+     * fit the candidate's segments are those up to the end of its last segment */
+    const quint8 available(availableCandidates(m_alphabet));
+    int length = 0;
+    int precedingLength = 0;
+    for (int candidate = 0; candidate < CandidateCount; ++candidate) {
+        if (!(available & (1 << candidate)))
+            continue;
+
+        const int representableLength = candidate == UCS2Candidate ? m_text.length() : m_firstUnrepresentable[candidate];
+        if (representableLength <= precedingLength)
+            continue;
+
+        Encoding baseEncoding, shiftEncoding;
+        candidateEncoding(candidate, m_alphabet, &baseEncoding, &shiftEncoding);
+
+        int fittingLength;
+        if (segmentCount == 1) {
+            fittingLength = segmentEnd(candidate, 0, segmentCapacity(baseEncoding, shiftEncoding, false));
+        } else {
+            const int capacity = segmentCapacity(baseEncoding, shiftEncoding, true);
+            fittingLength = 0;
+            for (int i = 0; i < segmentCount && fittingLength < representableLength; ++i)
+                fittingLength = segmentEnd(candidate, fittingLength, capacity);
+        }
+
+        fittingLength = qMin(fittingLength, representableLength);
+        if (fittingLength > precedingLength)
+            length = fittingLength;
+        precedingLength = representableLength;
+    }
+    return length;
+}
+
+int SmsTextCounter::remainingCharacterCountWithin(int segmentCount) const
+{
+    if (segmentCount <= 0)
+        return -m_characterCount;
+
+    const int singleCapacity = segmentCapacity(m_baseEncoding, m_shiftEncoding, false);
+    if (segmentCount == 1)
+        return singleCapacity - m_characterCount;
+
+    // Lay out the text in concatenated segments, as it will be once it exceeds a single message
+    updatePrefixCosts();
+
+    const int candidate = preferredCandidate(m_viableCandidates);
+    const int capacity = segmentCapacity(m_baseEncoding, m_shiftEncoding, true);
+    const int length = m_text.length();
+
+    int position = 0;
+    int lastSegmentCount = 0;
+    int segments = 0;
+    for ( ; segments < segmentCount && position < length; ++segments) {
+        const int end = segmentEnd(candidate, position, capacity);
+        lastSegmentCount = prefixCost(candidate, end) - prefixCost(candidate, position);
+        position = end;
+    }
+
+    if (position < length)
+        return prefixCost(candidate, position) - prefixCost(candidate, length);
+
+    return (segmentCount - segments) * capacity + (segments ? capacity - lastSegmentCount : 0);
+}
+
+int SmsTextCounter::memoryCost() const
+{
+    int cost = int(sizeof(SmsTextCounter));
+    cost += m_text.capacity() * int(sizeof(QChar));
+    if (!m_sourceSpans.isEmpty())
+        cost += m_sourceText.capacity() * int(sizeof(QChar)) + m_sourceSpans.capacity() * int(sizeof(SourceSpan));
+
+    // QList stores each boundary in a pointer-sized slot
+    cost += m_segmentBoundaries.count() * int(sizeof(void *));
+    for (int candidate = 0; candidate < CandidateCount - 1; ++candidate)
+        cost += m_prefixCosts[candidate].capacity() * int(sizeof(int));
+
+    QList<UnsupportedCharacter>::const_iterator it = m_unsupportedCharacters.constBegin(), end = m_unsupportedCharacters.constEnd();
+    for ( ; it != end; ++it)
+        cost += int(sizeof(UnsupportedCharacter)) + ((*it).character.capacity() + (*it).substitute.capacity()) * int(sizeof(QChar));
+
+    return cost;
+}
+
+void SmsTextCounter::squeeze()
+{
+    // The prefix costs occupy several times as much as the text, and are rebuilt on demand
+    for (int candidate = 0; candidate < CandidateCount - 1; ++candidate)
+        m_prefixCosts[candidate] = QVector<int>();
+    m_prefixCostsValid = 1;
+}
+
+void SmsTextCounter::updatePrefixCosts() const
+{
+    // Costs preceding the first modification since the last update remain valid
+    const int length = m_text.length();
+    if (m_prefixCostsValid > length)
+        return;
+
+    const int start = m_prefixCostsValid - 1;
+
+    quint8 baseTables[UCS2Candidate], shiftTables[UCS2Candidate];
+    for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+        Encoding baseEncoding, shiftEncoding;
+        candidateEncoding(candidate, m_alphabet, &baseEncoding, &shiftEncoding);
+        baseTables[candidate] = baseTable(baseEncoding);
+        shiftTables[candidate] = shiftTable(shiftEncoding);
+
+        m_prefixCosts[candidate].resize(length + 1);
+        if (m_firstUnrepresentable[candidate] >= start)
+            m_firstUnrepresentable[candidate] = -1;
+    }
+
+    for (int position = start; position < length; ++position) {
+        const quint8 membership(tableMembership(m_text.at(position)));
+        for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+            int cost = 1;
+            if (!(membership & baseTables[candidate])) {
+                if (membership & shiftTables[candidate]) {
+                    cost = 2;
+                } else if (m_firstUnrepresentable[candidate] == -1) {
+                    m_firstUnrepresentable[candidate] = position;
+                }
+            }
+
+            int *costs = m_prefixCosts[candidate].data();
+            costs[position + 1] = costs[position] + cost;
+        }
+    }
+
+    for (int candidate = 0; candidate < UCS2Candidate; ++candidate) {
+        if (m_firstUnrepresentable[candidate] == -1)
+            m_firstUnrepresentable[candidate] = length;
+    }
+    m_prefixCostsValid = length + 1;
+}
+
+// Returns the cost of the text preceding position, when encoded with the candidate
+int SmsTextCounter::prefixCost(int candidate, int position) const
+{
+    return candidate == UCS2Candidate ? position : m_prefixCosts[candidate].at(position);
+}
+
+// Returns the end of the longest run of text starting at position which fits within capacity when
+// encoded with the candidate, without separating an escape from its character or a surrogate pair
+int SmsTextCounter::segmentEnd(int candidate, int position, int capacity) const
+{
+    const int length = m_text.length();
+
+    if (candidate == UCS2Candidate) {
+        int end = qMin(length, position + capacity);
+        if (end > position && end < length && m_text.at(end - 1).isHighSurrogate() && m_text.at(end).isLowSurrogate())
+            --end;
+        return end;
+    }
+
+    // Each character's cost includes its escape, so the costs never divide an escape sequence
+    const QVector<int> &costs(m_prefixCosts[candidate]);
+    return std::upper_bound(costs.constBegin() + position, costs.constEnd(), costs.at(position) + capacity) - costs.constBegin() - 1;
+}
+
+void SmsTextCounter::updateReduction() const
+{
+    if (m_reductionValid)
+        return;
+
+    // Finding the unsupported characters requires examining the entire text, so this is only
+    // done when requested
+    m_reductionValid = true;
+    m_unsupportedCharacters.clear();
+
+    const quint8 tables(alphabetTables(m_alphabet));
+    for (int i = 0; i < m_text.length(); ++i) {
+        if (tableMembership(m_text.at(i)) & tables)
+            continue;
+
+        // A surrogate pair is reported as a single character
+        const int width = (m_text.at(i).isHighSurrogate() && i + 1 < m_text.length() && m_text.at(i + 1).isLowSurrogate()) ? 2 : 1;
+
+        UnsupportedCharacter character;
+        character.position = i;
+        character.character = m_text.mid(i, width);
+        if (const Substitution *substitution = findSubstitution(m_text.at(i))) {
+            for (const ushort *it = substitution->replacement; *it; ++it)
+                character.substitute.append(QChar(*it));
+        }
+        m_unsupportedCharacters.append(character);
+
+        i += width - 1;
+    }
+
+    m_reducedMessageCount = countText(substituteCharacters(m_text, m_alphabet), m_alphabet).messageCount;
+}
+
+void SmsTextCounter::restart(const QString &text)
+{
+    m_text = text;
+    m_prefixCostsValid = 1;
+
+    std::fill(m_membershipCounts, m_membershipCounts + MembershipCount, 0);
+    for (int position = 0; position < m_text.length(); position += countBlockSize) {
+        if (isCancelled())
+            return;
+        countMemberships(m_text.constData() + position, qMin(countBlockSize, m_text.length() - position), 1, m_membershipCounts);
+    }
+}
+
+void SmsTextCounter::replaceText(int position, int length, const QString &text)
+{
+    // Remove the replaced characters from the counts, and add their replacements
+    countMemberships(m_text.constData() + position, length, -1, m_membershipCounts);
+    countMemberships(text.constData(), text.length(), 1, m_membershipCounts);
+
+    m_text.replace(position, length, text);
+    m_prefixCostsValid = qMin(m_prefixCostsValid, position + 1);
+}
+
+void SmsTextCounter::updateCounts(int position, int removedLength, int insertedLength)
+{
+    const QChar *text = m_text.constData();
+    const int length = m_text.length();
+
+    int capacity = segmentCapacity(m_baseEncoding, m_shiftEncoding, false);
+    int lastSegmentCount = m_characterCount;
+    QList<int> segmentBoundaries;
+
+    if (m_characterCount > capacity) {
+        capacity = segmentCapacity(m_baseEncoding, m_shiftEncoding, true);
+
+        // Segments ending before the modified text are unchanged, unless the encoding has changed
+        QList<int>::const_iterator previous = m_segmentBoundaries.constBegin(), previousEnd = m_segmentBoundaries.constEnd();
+        if (m_baseEncoding != m_segmentBaseEncoding || m_shiftEncoding != m_segmentShiftEncoding)
+            previous = previousEnd;
+
+        int start = 0;
+        for ( ; previous != previousEnd && *previous + 1 < position; ++previous) {
+            start = *previous;
+            segmentBoundaries.append(start);
+        }
+
+        // Beyond the modified text, once a segment starts where one did previously, the following
+        // segments are also unchanged
+        const int delta = insertedLength - removedLength;
+        while ((start = nextSegmentStart(text, length, start, m_baseEncoding, capacity, &lastSegmentCount)) != length) {
+            if (isCancelled())
+                break;
+            segmentBoundaries.append(start);
+
+            if (start >= position + insertedLength) {
+                for ( ; previous != previousEnd && *previous + delta < start; ++previous)
+                    ;
+                if (previous != previousEnd && *previous + delta == start) {
+                    for (++previous; previous != previousEnd; ++previous)
+                        segmentBoundaries.append(*previous + delta);
+                    lastSegmentCount = m_lastSegmentCount;
+                    break;
+                }
+            }
+        }
+    }
+
+    m_segmentBoundaries = segmentBoundaries;
+    m_segmentBaseEncoding = m_baseEncoding;
+    m_segmentShiftEncoding = m_shiftEncoding;
+    m_capacity = capacity;
+    m_lastSegmentCount = lastSegmentCount;
+
+    // Characters that none of the available tables contain force the text to be encoded in UCS-2
+    const quint8 tables(alphabetTables(m_alphabet));
+    int unsupportedCount = 0;
+    for (int membership = 0; membership < MembershipCount; ++membership) {
+        if (!(membership & tables))
+            unsupportedCount += m_membershipCounts[membership];
+    }
+
+    // Finding the unsupported characters themselves is deferred until they are requested
+    m_unsupportedCount = unsupportedCount;
+    m_reductionValid = !unsupportedCount;
+    if (!unsupportedCount)
+        m_unsupportedCharacters.clear();
+}
+
+bool SmsTextCounter::isCancelled() const
+{
+    return m_cancelled && m_cancelled->loadAcquire();
+}
+
+void SmsTextCounter::selectEncoding()
+{
+    m_viableCandidates = measureCandidates(m_membershipCounts, m_text.length(), m_alphabet, m_candidateLengths);
+
+    const int candidate = preferredCandidate(m_viableCandidates);
+    candidateEncoding(candidate, m_alphabet, &m_baseEncoding, &m_shiftEncoding);
+    m_characterCount = m_candidateLengths[candidate];
+}
@@ -0,0 +1,235 @@
+/* Copyright (C) 2015 Jolla Ltd
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef SMSTEXTCOUNTER_H
+#define SMSTEXTCOUNTER_H
+
+#include <QAtomicInt>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/* Counts the SMS messages required for a text as ofono would encode it, and maintains the count
+ * as the text is edited. This is a value type without signals or thread affinity: distinct
+ * counters may be used in different threads at once, although, as with Qt's value classes, a
+ * single counter must not be used by more than one thread at a time */
+class SmsTextCounter
+{
+public:
+    // Extension language sets are not supported by ofono
+    enum Encoding { Default, Spanish, Portuguese, Turkish, UCS2 };
+
+    // Characters are classified by the set of GSM tables that can represent them
+    enum { MembershipCount = 128 };
+
+    // The default tables, national language single shift, national language locking shift and UCS-2
+    enum { CandidateCount = 4 };
+
+    // The encoding and message count of a text that is not being edited
+    struct TextCount {
+        Encoding baseEncoding;
+        Encoding shiftEncoding;
+        int messageCount;
+        int remainingCharacterCount;
+    };
+
+    /* A modification of the text, as the span of the counted text that is replaced and its
+     * replacement, which is not yet normalized */
+    struct Edit {
+        int position;
+        int removedLength;
+        // The span of the text as supplied that is replaced
+        int sourcePosition;
+        int sourceRemovedLength;
+        QString span;
+        // The entire text as supplied, where the edit was derived from it
+        QString source;
+        /* Whether the edit replaces the text entirely, sharing no characters with it at either
+         * end, rather than modifying a span that extends to both ends */
+        bool replacesText;
+    };
+
+    // An encoding that ofono would consider for the text
+    struct EncodingCandidate {
+        Encoding baseEncoding;
+        Encoding shiftEncoding;
+        bool lockingShift;
+        bool viable;
+        // The septets (or UCS-2 code units) required, or -1 if the encoding is not viable
+        int characterCount;
+
+        bool operator==(const EncodingCandidate &other) const;
+    };
+
+    // A character that prevents the text from being encoded with the GSM tables
+    struct UnsupportedCharacter {
+        int position;
+        QString character;
+        // The replacement in the default GSM table, if there is one
+        QString substitute;
+    };
+
+    explicit SmsTextCounter(Encoding alphabet = Default, bool reduce = false);
+
+    // Counts the text, as it would be encoded with the given alphabet available
+    static TextCount countText(const QString &text, Encoding alphabet);
+
+    // Counts each of the texts, as it would be encoded with the given alphabet available
+    static QVector<TextCount> countTexts(const QStringList &texts, Encoding alphabet);
+
+    // The text as counted, which is normalized and, if reducing, has its substitutions applied
+    QString text() const;
+    // The text as last supplied, to which later edits refer
+    QString sourceText() const;
+
+    /* Replaces the text, returning whether the counted text was modified; only the characters
+     * that differ from the existing text are examined */
+    bool setText(const QString &text);
+
+    /* Replaces removedLength characters at position in the source text with inserted, returning
+     * whether the counted text was modified */
+    bool applyEdit(int position, int removedLength, const QString &inserted);
+
+    /* Setting the text is divided into finding the edit and applying it, so that the edit can be
+     * inspected first; an edit must be applied to the counter it was found for, unmodified */
+    Edit textEdit(const QString &text) const;
+    Edit textEdit(int position, int removedLength, const QString &inserted) const;
+    bool applyEdit(const Edit &edit);
+
+    // Returns the source text that results from the edit
+    QString editedText(const Edit &edit) const;
+
+    /* Counting is abandoned, block by block, once the flag is set; the counts of a counter whose
+     * counting was abandoned are incomplete, and it should be discarded */
+    void setCancellation(const QAtomicInt *cancelled);
+
+    // The national language alphabet that ofono may fall back to; returns whether the text was modified
+    Encoding alphabet() const;
+    bool setAlphabet(Encoding alphabet);
+
+    // When set, unsupported characters are replaced by their substitutes; returns whether the text was modified
+    bool reduce() const;
+    bool setReduce(bool reduce);
+
+    Encoding baseEncoding() const;
+    Encoding shiftEncoding() const;
+
+    // The septets (or UCS-2 code units) required for the text
+    int characterCount() const;
+
+    int messageCount() const;
+    int remainingCharacterCount() const;
+
+    /* The positions in the text at which each message after the first begins; each message ends
+     * where the next begins, and the last ends at the end of the text */
+    QList<int> segmentBoundaries() const;
+
+    // The encodings that ofono would consider for the text, in order of preference
+    QVector<EncodingCandidate> encodingCandidates() const;
+
+    int unsupportedCount() const;
+    QList<UnsupportedCharacter> unsupportedCharacters() const;
+
+    // The number of messages that would be required with the unsupported characters substituted
+    int reducedMessageCount() const;
+
+    /* Returns the length of the longest prefix of the text which can be sent in no more than
+     * segmentCount messages, in whichever encoding that prefix would use */
+    int truncatedLength(int segmentCount) const;
+
+    /* Returns the number of characters that can be added, in the current encoding, before the
+     * text requires more than segmentCount messages; this is negative if it already does */
+    int remainingCharacterCountWithin(int segmentCount) const;
+
+    /* Returns the approximate number of bytes the counter occupies, including the state derived
+     * from the text; copies of a counter share their text until either is modified */
+    int memoryCost() const;
+
+    /* Releases the state that is only derived from the text when requested, so that a counter
+     * kept for later use occupies little more than its text */
+    void squeeze();
+
+private:
+    void restart(const QString &text);
+    void replaceText(int position, int length, const QString &text);
+    void updateCounts(int position, int removedLength, int insertedLength);
+    void selectEncoding();
+    bool recountSource();
+    bool isCancelled() const;
+
+    int textPosition(int sourcePosition) const;
+    int containingSpanStart(int sourcePosition) const;
+    int containingSpanEnd(int sourcePosition) const;
+    void updateSourceSpans(const Edit &edit, const QString &inserted);
+
+    void updateReduction() const;
+
+    void updatePrefixCosts() const;
+    int prefixCost(int candidate, int position) const;
+    int segmentEnd(int candidate, int position, int capacity) const;
+
+    /* A span of the text as supplied which differs from the counted text, being altered by
+     * normalization or substitution; elsewhere the two are identical */
+    struct SourceSpan {
+        int sourcePosition;
+        int sourceLength;
+        int position;
+        int length;
+    };
+
+    QString m_text;
+    // The text as supplied, kept only while it differs from ours
+    QString m_sourceText;
+    QVector<SourceSpan> m_sourceSpans;
+    Encoding m_alphabet;
+    bool m_reduce;
+    const QAtomicInt *m_cancelled;
+    int m_characterCount;
+    Encoding m_baseEncoding;
+    Encoding m_shiftEncoding;
+    QList<int> m_segmentBoundaries;
+    Encoding m_segmentBaseEncoding;
+    Encoding m_segmentShiftEncoding;
+    int m_capacity;
+    int m_lastSegmentCount;
+    int m_membershipCounts[MembershipCount];
+    int m_candidateLengths[CandidateCount];
+    quint8 m_viableCandidates;
+    int m_unsupportedCount;
+    mutable QVector<int> m_prefixCosts[CandidateCount - 1];
+    mutable int m_firstUnrepresentable[CandidateCount - 1];
+    mutable int m_prefixCostsValid;
+    mutable bool m_reductionValid;
+    mutable QList<UnsupportedCharacter> m_unsupportedCharacters;
+    mutable int m_reducedMessageCount;
+};
+
+#endif
@@ -8,9 +8,11 @@ PKGCONFIG += TelepathyQt5 commhistory-qt5 qtcontacts-sqlite-qt5-extensions
 
 QT = \
     core \
+    concurrent \
     contacts \
     dbus \
-    qml
+    qml \
+    quick
 
 target.path = $$[QT_INSTALL_QML]/$$PLUGIN_IMPORT_PATH
 
@@ -19,6 +21,8 @@ SOURCES += plugin.cpp \
     conversationchannel.cpp \
     channelmanager.cpp \
     smscharactercounter.cpp \
+    smstextcounter.cpp \
+    smsencoder.cpp \
     mmsmessageprogress.cpp \
     declarativeaccount.cpp \
     smssender.cpp
@@ -27,6 +31,9 @@ HEADERS += accountsmodel.h \
     conversationchannel.h \
     channelmanager.h \
     smscharactercounter.h \
+    smstextcounter.h \
+    smsalphabet.h \
+    smsencoder.h \
     mmsmessageprogress.h \
     declarativeaccount.h \
     smssender.h
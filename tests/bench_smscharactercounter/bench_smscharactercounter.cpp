@@ -0,0 +1,364 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QElapsedTimer>
+#include <QtTest>
+
+#include "smscharactercounter.h"
+
+namespace {
+
+struct Corpus {
+    const char *name;
+    const char *alphabet;
+    QString sentence;
+};
+
+const Corpus corpora[] = {
+    { "english", "default", QStringLiteral("The quick brown fox jumps over the lazy dog, then naps until half past 3. ") },
+    { "turkish", "turkish", QStringLiteral("Pijamal\u0131 hasta ya\u011F\u0131z \u015Fof\u00F6re \u00E7abucak g\u00FCvendi. ") },
+    { "spanish", "spanish", QStringLiteral("El ping\u00FCino Wenceslao hizo kil\u00F3metros bajo exhaustiva lluvia y fr\u00EDo; a\u00F1oraba su querido cachorro. ") },
+    { "portuguese", "portuguese", QStringLiteral("Lu\u00EDs arg\u00FCia \u00E0 J\u00FAlia que bra\u00E7\u00F5es, f\u00E9, ch\u00E1, \u00F3xido, p\u00F4r e z\u00E2ng\u00E3o eram palavras do portugu\u00EAs. ") },
+    { "russian", "default", QStringLiteral("\u0421\u044A\u0435\u0448\u044C \u0436\u0435 \u0435\u0449\u0451 \u044D\u0442\u0438\u0445 \u043C\u044F\u0433\u043A\u0438\u0445 \u0444\u0440\u0430\u043D\u0446\u0443\u0437\u0441\u043A\u0438\u0445 \u0431\u0443\u043B\u043E\u043A, \u0434\u0430 \u0432\u044B\u043F\u0435\u0439 \u0447\u0430\u044E. ") },
+    { "emoji", "default", QStringLiteral("Running late \U0001F605 see you at 8 {bring snacks} ~ ok? ") },
+};
+
+// Repeats the corpus sentence up to the required length, without dividing a surrogate pair
+QString corpusText(const QString &sentence, int length)
+{
+    QString text;
+    text.reserve(length + sentence.length());
+    while (text.length() < length)
+        text += sentence;
+    text.truncate(length);
+    if (!text.isEmpty() && text.at(length - 1).isHighSurrogate())
+        text.chop(1);
+    return text;
+}
+
+void addCorpusRows(const int *lengths, int lengthCount)
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<QString>("text");
+
+    for (const Corpus &corpus : corpora) {
+        for (int i = 0; i < lengthCount; ++i) {
+            const QByteArray name(QByteArray(corpus.name) + ' ' + QByteArray::number(lengths[i]));
+            QTest::newRow(name.constData()) << QString::fromLatin1(corpus.alphabet) << corpusText(corpus.sentence, lengths[i]);
+        }
+    }
+}
+
+void report(qint64 nsecs, int iterations, int edits, qint64 characters)
+{
+    if (!iterations)
+        return;
+
+    const double nsecsPerIteration = double(nsecs) / iterations;
+    qDebug("%s: %.0f ns/keystroke, %.0f chars/s", QTest::currentDataTag(),
+           nsecsPerIteration / edits, nsecsPerIteration ? characters * 1e9 / nsecsPerIteration : 0.0);
+}
+
+}
+
+class bench_SmsCharacterCounter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void typing_data();
+    void typing();
+    void middleEdits_data();
+    void middleEdits();
+    void backspacing_data();
+    void backspacing();
+    void paste_data();
+    void paste();
+    void leadingEmoji_data();
+    void leadingEmoji();
+    void leadingLigature_data();
+    void leadingLigature();
+    void recycling_data();
+    void recycling();
+};
+
+void bench_SmsCharacterCounter::typing_data()
+{
+    const int lengths[] = { 160, 1000, 5000 };
+    addCorpusRows(lengths, 3);
+}
+
+void bench_SmsCharacterCounter::typing()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // Each keystroke supplies the whole text typed so far, as a text field would
+    QStringList keystrokes;
+    for (int i = 1; i <= text.length(); ++i)
+        keystrokes.append(text.left(i));
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+
+        SmsCharacterCounter counter;
+        counter.setAlphabet(alphabet);
+        foreach (const QString &keystroke, keystrokes)
+            counter.setText(keystroke);
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, keystrokes.count(), text.length());
+}
+
+void bench_SmsCharacterCounter::middleEdits_data()
+{
+    const int lengths[] = { 1000, 5000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::middleEdits()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // Type a word into the middle of the text, then delete it again
+    const QString word(QStringLiteral("inserted"));
+    const int position = text.length() / 2;
+
+    QStringList keystrokes;
+    for (int i = 1; i <= word.length(); ++i)
+        keystrokes.append(QString(text).insert(position, word.left(i)));
+    for (int i = word.length() - 1; i >= 0; --i)
+        keystrokes.append(QString(text).insert(position, word.left(i)));
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    SmsCharacterCounter counter;
+    counter.setAlphabet(alphabet);
+    counter.setText(text);
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+
+        foreach (const QString &keystroke, keystrokes)
+            counter.setText(keystroke);
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, keystrokes.count(), word.length());
+}
+
+void bench_SmsCharacterCounter::backspacing_data()
+{
+    const int lengths[] = { 1000, 5000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::backspacing()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    QStringList keystrokes;
+    for (int i = text.length() - 1; i >= 0; --i)
+        keystrokes.append(text.left(i));
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        SmsCharacterCounter counter;
+        counter.setAlphabet(alphabet);
+        counter.setText(text);
+
+        QElapsedTimer timer;
+        timer.start();
+
+        foreach (const QString &keystroke, keystrokes)
+            counter.setText(keystroke);
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, keystrokes.count(), text.length());
+}
+
+void bench_SmsCharacterCounter::paste_data()
+{
+    const int lengths[] = { 5000, 50000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::paste()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // Paste the text into an empty field, and then again into the middle of itself
+    const QString doubled(QString(text).insert(text.length() / 2, text));
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        // Measure counting rather than retrieval of the previous iteration's results
+        SmsCharacterCounter::clearCache();
+
+        QElapsedTimer timer;
+        timer.start();
+
+        SmsCharacterCounter counter;
+        counter.setAlphabet(alphabet);
+        counter.setText(text);
+        counter.setText(doubled);
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, 2, text.length() * 2);
+}
+
+void bench_SmsCharacterCounter::leadingEmoji_data()
+{
+    const int lengths[] = { 1000, 5000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::leadingEmoji()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // Adding and removing an emoji at the start of the text switches the whole text between
+    // its 7-bit encoding and UCS-2
+    const QString emoji(QStringLiteral("\U0001F600"));
+    const QStringList keystrokes(QStringList() << emoji + text << text);
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    SmsCharacterCounter counter;
+    counter.setAlphabet(alphabet);
+    counter.setText(text);
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+
+        for (int i = 0; i < 50; ++i) {
+            foreach (const QString &keystroke, keystrokes)
+                counter.setText(keystroke);
+        }
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, 100, 100 * emoji.length());
+}
+
+void bench_SmsCharacterCounter::leadingLigature_data()
+{
+    const int lengths[] = { 1000, 5000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::leadingLigature()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // A ligature at the start of the text is counted in its normalized form, so the counted
+    // text differs from the supplied text for every later keystroke
+    const QString word(QStringLiteral("appended"));
+    const QString prefixed(QStringLiteral("\uFB01") + text);
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    SmsCharacterCounter counter;
+    counter.setAlphabet(alphabet);
+    counter.setText(prefixed);
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+
+        for (int i = 0; i < word.length(); ++i)
+            counter.applyEdit(prefixed.length() + i, 0, word.mid(i, 1));
+        for (int i = word.length() - 1; i >= 0; --i)
+            counter.applyEdit(prefixed.length() + i, 1, QString());
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, word.length() * 2, word.length());
+}
+
+void bench_SmsCharacterCounter::recycling_data()
+{
+    const int lengths[] = { 160, 1000 };
+    addCorpusRows(lengths, 2);
+}
+
+void bench_SmsCharacterCounter::recycling()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+
+    // Scrolling a list of drafts reuses a few delegates, each replacing its text entirely
+    QStringList drafts;
+    for (int i = 0; i < 20; ++i)
+        drafts.append(QString::number(i) + text);
+
+    SmsCharacterCounter::clearCache();
+
+    qint64 nsecs = 0;
+    int iterations = 0;
+    QBENCHMARK {
+        QElapsedTimer timer;
+        timer.start();
+
+        SmsCharacterCounter counter;
+        counter.setAlphabet(alphabet);
+        foreach (const QString &draft, drafts)
+            counter.setText(draft);
+
+        nsecs += timer.nsecsElapsed();
+        ++iterations;
+    }
+    report(nsecs, iterations, drafts.count(), qint64(text.length()) * drafts.count());
+    qDebug("%s: %d cache hits, %d misses", QTest::currentDataTag(),
+           SmsCharacterCounter::cacheHitCount(), SmsCharacterCounter::cacheMissCount());
+}
+
+#include "bench_smscharactercounter.moc"
+QTEST_APPLESS_MAIN(bench_SmsCharacterCounter)
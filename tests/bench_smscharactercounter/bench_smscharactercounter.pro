@@ -0,0 +1,12 @@
+include(../common.pri)
+TARGET = bench_smscharactercounter
+
+QT += concurrent quick
+
+SOURCES += bench_smscharactercounter.cpp
+
+SOURCES += ../../src/smscharactercounter.cpp \
+    ../../src/smstextcounter.cpp
+HEADERS += ../../src/smscharactercounter.h \
+    ../../src/smstextcounter.h \
+    ../../src/smsalphabet.h
@@ -1,7 +1,11 @@
 include(../package.pri)
 
 TEMPLATE = subdirs
-SUBDIRS = tst_smscharactercounter
+SUBDIRS = tst_smscharactercounter \
+    tst_smstextcounter \
+    tst_smsencoder \
+    tst_conversationchannel \
+    bench_smscharactercounter
 OTHER_FILES += tests.xml.in
 
 tests_xml.target = tests.xml
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include "telepathystub.h"
+
+namespace Tp {
+
+QString Message::text() const
+{
+    // The body follows the header part
+    return mParts.count() > 1 ? mParts.at(1).value(QStringLiteral("content")).variant().toString() : QString();
+}
+
+PendingOperation::PendingOperation(QObject *parent)
+    : QObject(parent), mFinished(false)
+{
+}
+
+void PendingOperation::setFinished()
+{
+    mFinished = true;
+    emit finished(this);
+}
+
+void PendingOperation::setFinishedWithError(const QString &errorName, const QString &errorMessage)
+{
+    mFinished = true;
+    mErrorName = errorName;
+    mErrorMessage = errorMessage;
+    emit finished(this);
+}
+
+void DBusProxy::invalidate(const QString &errorName, const QString &errorMessage)
+{
+    emit invalidated(this, errorName, errorMessage);
+}
+
+PendingReady *Channel::becomeReady(int features)
+{
+    Q_UNUSED(features)
+    mPendingReady = new PendingReady(this);
+    return mPendingReady;
+}
+
+void Channel::makeReady()
+{
+    mReady = true;
+    if (mPendingReady) {
+        PendingReady *pendingReady = mPendingReady;
+        mPendingReady = 0;
+        pendingReady->setFinished();
+    }
+}
+
+PendingSendMessage *TextChannel::send(const MessagePartList &parts)
+{
+    PendingSendMessage *message = new PendingSendMessage(Message(parts), this);
+    mSentMessages.append(message);
+    return message;
+}
+
+PendingChannelRequest *Account::ensureTextChat(const QString &contactIdentifier, const QDateTime &userActionTime,
+                                               const QString &preferredHandler)
+{
+    Q_UNUSED(contactIdentifier)
+    Q_UNUSED(userActionTime)
+    Q_UNUSED(preferredHandler)
+    return new PendingChannelRequest(this);
+}
+
+}
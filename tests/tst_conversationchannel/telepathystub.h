@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#ifndef TELEPATHYSTUB_H
+#define TELEPATHYSTUB_H
+
+/* Stand-ins for the parts of TelepathyQt that ConversationChannel uses, so that its queueing can
+ * be tested without a telepathy connection; the test completes each operation itself */
+
+#include <QObject>
+#include <QDateTime>
+#include <QDBusVariant>
+#include <QList>
+#include <QMap>
+#include <QString>
+#include <QVariant>
+
+#include <algorithm>
+
+namespace Tp {
+
+class RefCounted
+{
+public:
+    RefCounted() : mRefCount(0) {}
+    virtual ~RefCounted() {}
+
+    void ref() const { ++mRefCount; }
+    bool deref() const { return --mRefCount != 0; }
+
+private:
+    mutable int mRefCount;
+};
+
+template <class T>
+class SharedPtr
+{
+public:
+    SharedPtr() : d(0) {}
+    explicit SharedPtr(T *d) : d(d) { if (d) d->ref(); }
+    SharedPtr(const SharedPtr &other) : d(other.d) { if (d) d->ref(); }
+    template <class X> SharedPtr(const SharedPtr<X> &other) : d(other.data()) { if (d) d->ref(); }
+    ~SharedPtr() { reset(); }
+
+    SharedPtr &operator=(const SharedPtr &other)
+    {
+        SharedPtr copy(other);
+        std::swap(d, copy.d);
+        return *this;
+    }
+
+    T *data() const { return d; }
+    T *operator->() const { return d; }
+    bool isNull() const { return !d; }
+    bool operator!() const { return !d; }
+    bool operator==(const SharedPtr &other) const { return d == other.d; }
+    bool operator!=(const SharedPtr &other) const { return d != other.d; }
+
+    void reset()
+    {
+        if (d && !d->deref())
+            delete d;
+        d = 0;
+    }
+
+    template <class X> static SharedPtr dynamicCast(const SharedPtr<X> &other)
+    {
+        return SharedPtr(dynamic_cast<T *>(other.data()));
+    }
+
+private:
+    T *d;
+};
+
+class Channel;
+class TextChannel;
+class ChannelRequest;
+class Account;
+class AccountManager;
+
+typedef SharedPtr<Channel> ChannelPtr;
+typedef SharedPtr<TextChannel> TextChannelPtr;
+typedef SharedPtr<ChannelRequest> ChannelRequestPtr;
+typedef SharedPtr<Account> AccountPtr;
+typedef SharedPtr<AccountManager> AccountManagerPtr;
+
+typedef QMap<QString, QDBusVariant> MessagePart;
+typedef QList<MessagePart> MessagePartList;
+
+class Message
+{
+public:
+    Message() {}
+    explicit Message(const MessagePartList &parts) : mParts(parts) {}
+
+    MessagePartList parts() const { return mParts; }
+    QString text() const;
+
+private:
+    MessagePartList mParts;
+};
+
+class ReceivedMessage : public Message
+{
+public:
+    QString messageToken() const { return QString(); }
+};
+
+class PendingOperation : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit PendingOperation(QObject *parent = 0);
+
+    bool isFinished() const { return mFinished; }
+    bool isValid() const { return mFinished && mErrorName.isEmpty(); }
+    bool isError() const { return mFinished && !mErrorName.isEmpty(); }
+    QString errorName() const { return mErrorName; }
+    QString errorMessage() const { return mErrorMessage; }
+
+    // Completes the operation, as telepathy would once the request is answered
+    void setFinished();
+    void setFinishedWithError(const QString &errorName, const QString &errorMessage);
+
+signals:
+    void finished(Tp::PendingOperation *operation);
+
+private:
+    bool mFinished;
+    QString mErrorName;
+    QString mErrorMessage;
+};
+
+class PendingReady : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    explicit PendingReady(QObject *parent = 0) : PendingOperation(parent) {}
+};
+
+class PendingSendMessage : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    PendingSendMessage(const Message &message, QObject *parent) : PendingOperation(parent), mMessage(message) {}
+
+    Message message() const { return mMessage; }
+
+private:
+    Message mMessage;
+};
+
+class PendingChannelRequest : public PendingOperation
+{
+    Q_OBJECT
+
+public:
+    explicit PendingChannelRequest(QObject *parent = 0) : PendingOperation(parent) {}
+
+signals:
+    void channelRequestCreated(const Tp::ChannelRequestPtr &request);
+};
+
+class ChannelRequest : public QObject, public RefCounted
+{
+    Q_OBJECT
+
+signals:
+    void succeeded(const Tp::ChannelPtr &channel);
+    void failed(const QString &errorName, const QString &errorMessage);
+};
+
+class DBusProxy : public QObject, public RefCounted
+{
+    Q_OBJECT
+
+public:
+    explicit DBusProxy(const QString &objectPath) : mObjectPath(objectPath) {}
+
+    QString objectPath() const { return mObjectPath; }
+
+    // Reports that the remote object has gone away
+    void invalidate(const QString &errorName, const QString &errorMessage);
+
+signals:
+    void invalidated(Tp::DBusProxy *proxy, const QString &errorName, const QString &errorMessage);
+
+private:
+    QString mObjectPath;
+};
+
+class Channel : public DBusProxy
+{
+    Q_OBJECT
+
+public:
+    explicit Channel(const QString &objectPath) : DBusProxy(objectPath), mReady(false), mPendingReady(0) {}
+
+    bool isReady() const { return mReady; }
+    PendingReady *becomeReady(int features = 0);
+
+    // Completes the request for the channel to become ready
+    void makeReady();
+
+private:
+    bool mReady;
+    PendingReady *mPendingReady;
+};
+
+class TextChannel : public Channel
+{
+    Q_OBJECT
+
+public:
+    enum { FeatureMessageQueue = 1 };
+
+    explicit TextChannel(const QString &objectPath) : Channel(objectPath) {}
+
+    PendingSendMessage *send(const MessagePartList &parts);
+    QList<ReceivedMessage> messageQueue() const { return QList<ReceivedMessage>(); }
+    void acknowledge(const QList<ReceivedMessage> &messages) { Q_UNUSED(messages) }
+
+    // The sends requested through the channel, in order, which remain to be completed by the test
+    QList<PendingSendMessage *> sentMessages() const { return mSentMessages; }
+
+signals:
+    void messageReceived(const Tp::ReceivedMessage &message);
+
+private:
+    QList<PendingSendMessage *> mSentMessages;
+};
+
+class Account : public QObject, public RefCounted
+{
+    Q_OBJECT
+
+public:
+    bool isReady() const { return true; }
+    PendingReady *becomeReady() { return new PendingReady(this); }
+    PendingChannelRequest *ensureTextChat(const QString &contactIdentifier, const QDateTime &userActionTime,
+                                          const QString &preferredHandler);
+};
+
+// The accounts are always ready, and contain none; conversations must be given their channels
+class AccountManager : public QObject, public RefCounted
+{
+    Q_OBJECT
+
+public:
+    bool isReady() const { return true; }
+    PendingReady *becomeReady() { return new PendingReady(this); }
+    AccountPtr accountForObjectPath(const QString &path) const { Q_UNUSED(path) return AccountPtr(); }
+};
+
+}
+
+#endif
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2026 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QtTest>
+
+#include "conversationchannel.h"
+#include "accountsmodel.h"
+
+// The conversations are given their channels directly, so the account manager is never consulted
+Tp::AccountManagerPtr AccountsModel::sharedAccountManager()
+{
+    return Tp::AccountManagerPtr(new Tp::AccountManager);
+}
+
+namespace {
+
+const QString localUid(QStringLiteral("/org/freedesktop/Telepathy/Account/ring/tel/account0"));
+const QString remoteUid(QStringLiteral("+15550100"));
+
+// Comfortably longer than the deadline after which sent events that commhistory does not report are retired
+const int retirementTimeout = 2000;
+
+Tp::TextChannelPtr addReadyChannel(ConversationChannel &conversation, const QString &objectPath)
+{
+    Tp::TextChannelPtr textChannel(new Tp::TextChannel(objectPath));
+    conversation.addChannel(textChannel);
+    textChannel->makeReady();
+    return textChannel;
+}
+
+QStringList sentTexts(const Tp::TextChannelPtr &textChannel)
+{
+    QStringList texts;
+    foreach (Tp::PendingSendMessage *message, textChannel->sentMessages())
+        texts.append(message->message().text());
+    return texts;
+}
+
+}
+
+class tst_ConversationChannel : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void queueOrder();
+    void sendWindow();
+    void failedSend();
+    void largeBacklog();
+    void channelLost();
+    void retirement();
+    void sequence();
+};
+
+void tst_ConversationChannel::queueOrder()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(2);
+    Tp::TextChannelPtr textChannel(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+    QCOMPARE(conversation.state(), ConversationChannel::Ready);
+
+    QSignalSpy succeeded(&conversation, SIGNAL(sendingSucceeded(int,ConversationChannel*)));
+    QSignalSpy drained(&conversation, SIGNAL(queueDrained()));
+
+    // Only the messages that fit in the send window are handed to telepathy
+    for (int i = 1; i <= 5; ++i)
+        conversation.sendMessage(QString::number(i), i);
+    QCOMPARE(sentTexts(textChannel), QStringList() << "1" << "2");
+    QCOMPARE(conversation.inFlightCount(), 2);
+    QCOMPARE(conversation.queuedCount(), 3);
+    for (int i = 1; i <= 5; ++i)
+        QVERIFY(conversation.eventIsPending(i));
+
+    // Each completed send admits the next queued message, in the order they were sent
+    for (int i = 0; i < 5; ++i) {
+        textChannel->sentMessages().at(i)->setFinished();
+        QVERIFY(conversation.inFlightCount() <= 2);
+    }
+    QCOMPARE(sentTexts(textChannel), QStringList() << "1" << "2" << "3" << "4" << "5");
+    QCOMPARE(conversation.inFlightCount(), 0);
+    QCOMPARE(conversation.queuedCount(), 0);
+    QCOMPARE(succeeded.count(), 5);
+    QCOMPARE(succeeded.at(4).at(0).toInt(), 5);
+    QCOMPARE(drained.count(), 1);
+}
+
+void tst_ConversationChannel::sendWindow()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(2);
+
+    // Messages sent before the channel is ready are buffered
+    Tp::TextChannelPtr textChannel(new Tp::TextChannel(QStringLiteral("/channel/0")));
+    conversation.addChannel(textChannel);
+    for (int i = 1; i <= 4; ++i)
+        conversation.sendMessage(QString::number(i), i);
+    QCOMPARE(conversation.queuedCount(), 4);
+    QCOMPARE(conversation.inFlightCount(), 0);
+    QVERIFY(textChannel->sentMessages().isEmpty());
+
+    // Once it is ready, the buffer is flushed only as far as the window allows
+    textChannel->makeReady();
+    QCOMPARE(sentTexts(textChannel), QStringList() << "1" << "2");
+    QCOMPARE(conversation.queuedCount(), 2);
+
+    // Widening the window admits more
+    conversation.setMaximumInFlight(3);
+    QCOMPARE(sentTexts(textChannel), QStringList() << "1" << "2" << "3");
+
+    // And removing the limit admits the rest
+    conversation.setMaximumInFlight(0);
+    QCOMPARE(sentTexts(textChannel), QStringList() << "1" << "2" << "3" << "4");
+    QCOMPARE(conversation.queuedCount(), 0);
+    QCOMPARE(conversation.inFlightCount(), 4);
+
+    // Later messages are sent immediately
+    conversation.sendMessage(QStringLiteral("5"), 5);
+    QCOMPARE(conversation.inFlightCount(), 5);
+}
+
+void tst_ConversationChannel::failedSend()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(1);
+    Tp::TextChannelPtr textChannel(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+
+    QSignalSpy failed(&conversation, SIGNAL(sendingFailed(int,ConversationChannel*)));
+    QSignalSpy sequenceChanged(&conversation, SIGNAL(sequenceChanged()));
+    conversation.sendMessage(QStringLiteral("first"), 1);
+    conversation.sendMessage(QStringLiteral("second"), 2);
+    QTRY_COMPARE(sequenceChanged.count(), 1);
+
+    // A failed send is no longer pending, and makes room for the next message
+    const int sequence = conversation.sequence();
+    textChannel->sentMessages().at(0)->setFinishedWithError(QStringLiteral("org.freedesktop.Telepathy.Error.NetworkError"), QString());
+    QCOMPARE(failed.count(), 1);
+    QCOMPARE(failed.at(0).at(0).toInt(), 1);
+    QVERIFY(!conversation.eventIsPending(1));
+    QVERIFY(conversation.eventIsPending(2));
+    QCOMPARE(conversation.sequence(), sequence + 1);
+    QCOMPARE(sentTexts(textChannel), QStringList() << "first" << "second");
+}
+
+void tst_ConversationChannel::largeBacklog()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(4);
+    Tp::TextChannelPtr textChannel(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+
+    // A long backlog drains through the window in order
+    const int count = 5000;
+    for (int i = 0; i < count; ++i)
+        conversation.sendMessage(QString::number(i), i);
+    QCOMPARE(conversation.queuedCount(), count - 4);
+
+    for (int i = 0; i < count; ++i)
+        textChannel->sentMessages().at(i)->setFinished();
+
+    const QList<Tp::PendingSendMessage *> sent(textChannel->sentMessages());
+    QCOMPARE(sent.count(), count);
+    for (int i = 0; i < count; ++i)
+        QCOMPARE(sent.at(i)->message().text(), QString::number(i));
+    QCOMPARE(conversation.queuedCount(), 0);
+}
+
+void tst_ConversationChannel::channelLost()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(1);
+    Tp::TextChannelPtr first(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+
+    QSignalSpy failed(&conversation, SIGNAL(sendingFailed(int,ConversationChannel*)));
+    conversation.sendMessage(QStringLiteral("first"), 1);
+    conversation.sendMessage(QStringLiteral("second"), 2);
+
+    // Queued messages survive the loss of the channel, waiting for it to be requested again
+    first->invalidate(QStringLiteral("org.freedesktop.Telepathy.Error.Disconnected"), QString());
+    QCOMPARE(conversation.state(), ConversationChannel::Null);
+    QCOMPARE(conversation.queuedCount(), 1);
+    QCOMPARE(failed.count(), 0);
+    QVERIFY(conversation.eventIsPending(2));
+
+    // The replacement channel takes the queued message once the window has room
+    Tp::TextChannelPtr second(addReadyChannel(conversation, QStringLiteral("/channel/1")));
+    QCOMPARE(conversation.state(), ConversationChannel::Ready);
+    QVERIFY(second->sentMessages().isEmpty());
+
+    first->sentMessages().at(0)->setFinished();
+    QCOMPARE(sentTexts(second), QStringList() << "second");
+    QCOMPARE(conversation.queuedCount(), 0);
+    QCOMPARE(failed.count(), 0);
+}
+
+void tst_ConversationChannel::retirement()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    Tp::TextChannelPtr textChannel(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+
+    QSignalSpy sequenceChanged(&conversation, SIGNAL(sequenceChanged()));
+    conversation.sendMessage(QStringLiteral("reported"), 1);
+    conversation.sendMessage(QStringLiteral("unreported"), 2);
+    textChannel->sentMessages().at(0)->setFinished();
+    textChannel->sentMessages().at(1)->setFinished();
+    QTRY_COMPARE(sequenceChanged.count(), 1);
+
+    // Sent events remain pending until commhistory reports them
+    QVERIFY(conversation.eventIsPending(1));
+    QVERIFY(conversation.eventIsPending(2));
+
+    int sequence = conversation.sequence();
+    conversation.eventStatusReported(1);
+    QVERIFY(!conversation.eventIsPending(1));
+    QCOMPARE(conversation.sequence(), sequence + 1);
+    QTRY_COMPARE(sequenceChanged.count(), 2);
+
+    // The same event sent again later has a deadline of its own
+    QTest::qWait(400);
+    conversation.sendMessage(QStringLiteral("reported"), 1);
+    textChannel->sentMessages().at(2)->setFinished();
+    QTRY_COMPARE(sequenceChanged.count(), 3);
+
+    // Unreported events are retired once their deadline has passed
+    sequence = conversation.sequence();
+    QTRY_VERIFY_WITH_TIMEOUT(!conversation.eventIsPending(2), retirementTimeout);
+    QCOMPARE(conversation.sequence(), sequence + 1);
+
+    // The deadline of the reported send has passed, but does not retire the later send
+    QVERIFY(conversation.eventIsPending(1));
+    QTRY_VERIFY_WITH_TIMEOUT(!conversation.eventIsPending(1), retirementTimeout);
+    QCOMPARE(conversation.sequence(), sequence + 2);
+}
+
+void tst_ConversationChannel::sequence()
+{
+    ConversationChannel conversation(localUid, remoteUid);
+    conversation.setMaximumInFlight(1);
+    Tp::TextChannelPtr textChannel(addReadyChannel(conversation, QStringLiteral("/channel/0")));
+
+    QSignalSpy sequenceChanged(&conversation, SIGNAL(sequenceChanged()));
+    const int sequence = conversation.sequence();
+
+    // The sequence changes at once, but changes in the same pass of the event loop are notified together
+    for (int i = 1; i <= 3; ++i)
+        conversation.sendMessage(QString::number(i), i);
+    QCOMPARE(conversation.sequence(), sequence + 1);
+    QCOMPARE(sequenceChanged.count(), 0);
+    QTRY_COMPARE(sequenceChanged.count(), 1);
+
+    // Events reported by commhistory leave the pending set
+    textChannel->sentMessages().at(0)->setFinished();
+    conversation.eventStatusReported(1);
+    QCOMPARE(conversation.sequence(), sequence + 2);
+    QTRY_COMPARE(sequenceChanged.count(), 2);
+
+    // Reports of events that are not pending change nothing
+    conversation.eventStatusReported(1);
+    conversation.eventStatusReported(7);
+    QCOMPARE(conversation.sequence(), sequence + 2);
+}
+
+#include "tst_conversationchannel.moc"
+QTEST_GUILESS_MAIN(tst_ConversationChannel)
@@ -0,0 +1,14 @@
+include(../common.pri)
+TARGET = tst_conversationchannel
+
+QT += dbus
+
+# The stub TelepathyQt headers in this directory stand in for the library
+INCLUDEPATH += $$PWD
+
+SOURCES += tst_conversationchannel.cpp \
+    telepathystub.cpp
+
+SOURCES += ../../src/conversationchannel.cpp
+HEADERS += telepathystub.h \
+    ../../src/conversationchannel.h
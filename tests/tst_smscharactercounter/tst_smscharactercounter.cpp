@@ -45,6 +45,29 @@ public:
 private slots:
     void test_data();
     void test();
+    void alphabet_data();
+    void alphabet();
+    void alphabetChange();
+    void edits_data();
+    void edits();
+    void normalization_data();
+    void normalization();
+    void segmentBoundaries_data();
+    void segmentBoundaries();
+    void countTexts_data();
+    void countTexts();
+    void countTextsVariant();
+    void asynchronous();
+    void unsupportedCharacters_data();
+    void unsupportedCharacters();
+    void reduce();
+    void cache();
+    void applyEdit_data();
+    void applyEdit();
+    void encodingCandidates();
+    void truncatedLength_data();
+    void truncatedLength();
+    void remainingCharacterCountWithin();
 
 private:
     SmsCharacterCounter counter;
@@ -101,6 +124,10 @@ void tst_SmsCharacterCounter::test_data()
         << "\u20ACAB"
         << 1
         << 156;
+    QTest::newRow("7-bit characters outside Latin-1")
+        << "\u0394\u03A9"
+        << 1
+        << 158;
     QTest::newRow("single 16-bit character")
         << "\u2022"
         << 1
@@ -199,5 +226,642 @@ void tst_SmsCharacterCounter::test()
     QCOMPARE(counter.remainingCharacterCount(), remainingCharacterCount);
 }
 
+void tst_SmsCharacterCounter::alphabet_data()
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("messageCount");
+    QTest::addColumn<int>("remainingCharacterCount");
+
+    QTest::newRow("default alphabet, national character")
+        << "default"
+        << "\u011F"
+        << 1
+        << 69;
+    QTest::newRow("turkish single shift")
+        << "turkish"
+        << "\u011F"
+        << 1
+        << 153;
+    QTest::newRow("turkish single shift, extended")
+        << "turkish"
+        << "A\u0131\u011F\u20AC"
+        << 1
+        << 148;
+    QTest::newRow("spanish single shift")
+        << "spanish"
+        << "\u00E1"
+        << 1
+        << 153;
+    QTest::newRow("spanish, unrepresentable character")
+        << "spanish"
+        << "\u00E1\u00E3"
+        << 1
+        << 68;
+    QTest::newRow("portuguese single shift")
+        << "portuguese"
+        << "\u00E3"
+        << 1
+        << 153;
+    QTest::newRow("portuguese locking shift")
+        << "portuguese"
+        << "\u00E3\u221E"
+        << 1
+        << 150;
+    QTest::newRow("portuguese locking shift, not in default base")
+        << "portuguese"
+        << "\u00E8\u221E"
+        << 1
+        << 68;
+    QTest::newRow("exceed a single message, turkish single shift")
+        << "turkish"
+        << "0123456789" "0123456789" "0123456789" "0123456789"
+           "0123456789" "0123456789" "0123456789" "0123456789"
+           "0123456789" "0123456789" "0123456789" "0123456789"
+           "0123456789" "0123456789" "0123456789" "012345"
+           "\u011F"
+        << 2
+        << 140;
+}
+
+void tst_SmsCharacterCounter::alphabet()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+    QFETCH(int, messageCount);
+    QFETCH(int, remainingCharacterCount);
+
+    SmsCharacterCounter alphabetCounter;
+    alphabetCounter.setAlphabet(alphabet);
+    QCOMPARE(alphabetCounter.alphabet(), alphabet);
+
+    // Enter the text incrementally, to exercise the transitions between encodings
+    for (int i = 1; i <= text.length(); ++i) {
+        alphabetCounter.setText(text.left(i));
+    }
+    QCOMPARE(alphabetCounter.messageCount(), messageCount);
+    QCOMPARE(alphabetCounter.remainingCharacterCount(), remainingCharacterCount);
+
+    // The same result must be produced by counting from scratch
+    SmsCharacterCounter scratchCounter;
+    scratchCounter.setAlphabet(alphabet);
+    scratchCounter.setText(text);
+    QCOMPARE(scratchCounter.messageCount(), messageCount);
+    QCOMPARE(scratchCounter.remainingCharacterCount(), remainingCharacterCount);
+}
+
+void tst_SmsCharacterCounter::alphabetChange()
+{
+    SmsCharacterCounter alphabetCounter;
+    alphabetCounter.setText(QString::fromUtf8("\u011F\u015F"));
+    QCOMPARE(alphabetCounter.remainingCharacterCount(), 68);
+
+    alphabetCounter.setAlphabet(QStringLiteral("turkish"));
+    QCOMPARE(alphabetCounter.remainingCharacterCount(), 151);
+
+    alphabetCounter.setAlphabet(QStringLiteral("default"));
+    QCOMPARE(alphabetCounter.remainingCharacterCount(), 68);
+}
+
+void tst_SmsCharacterCounter::edits_data()
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<QStringList>("texts");
+
+    QTest::newRow("insert in the middle")
+        << "default"
+        << (QStringList() << "Hello world" << "Hello, world" << "Hello, \u20ACworld" << "Hello, \u2022\u20ACworld");
+    QTest::newRow("replace a word")
+        << "default"
+        << (QStringList() << "See you tomorow!" << "See you tomorrow!" << "See you {tomorrow}!" << "See you later!");
+    QTest::newRow("remove from the middle")
+        << "default"
+        << (QStringList() << "0123456789\u20AC0123456789" << "01234567890123456789" << "0123489" << "89");
+    QTest::newRow("remove from UCS-2 text")
+        << "default"
+        << (QStringList() << "\u2022 first\n\u2022 second" << "first\n\u2022 second" << "first\n second" << "first second");
+    QTest::newRow("remove emoji from the end")
+        << "default"
+        << (QStringList() << "See you later \U0001F600" << "See you later \U0001F600\U0001F600" << "See you later \U0001F600" << "See you later ");
+    QTest::newRow("replace in national language text")
+        << "turkish"
+        << (QStringList() << "G\u00FCle g\u00FCle" << "G\u00FCle g\u00FCle \u011Fule" << "G\u00FCle \u011Fule" << "G\u00FCle" << "\u015Eule");
+    QTest::newRow("paste into the middle")
+        << "portuguese"
+        << (QStringList() << "Ol\u00E1 tudo bem?" << "Ol\u00E1 \u221E tudo bem?" << "Ol\u00E1 \u221E tudo bem, \u00E8?" << "Ol\u00E1 tudo bem?");
+}
+
+void tst_SmsCharacterCounter::edits()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QStringList, texts);
+
+    SmsCharacterCounter editCounter;
+    editCounter.setAlphabet(alphabet);
+
+    foreach (const QString &text, texts) {
+        editCounter.setText(text);
+        QCOMPARE(editCounter.text(), text);
+
+        // Each edit must produce the same result as counting from scratch
+        SmsCharacterCounter scratchCounter;
+        scratchCounter.setAlphabet(alphabet);
+        scratchCounter.setText(text);
+        QCOMPARE(editCounter.messageCount(), scratchCounter.messageCount());
+        QCOMPARE(editCounter.remainingCharacterCount(), scratchCounter.remainingCharacterCount());
+        QCOMPARE(editCounter.segmentBoundaries(), scratchCounter.segmentBoundaries());
+    }
+}
+
+void tst_SmsCharacterCounter::normalization_data()
+{
+    QTest::addColumn<QStringList>("texts");
+
+    QTest::newRow("combining mark appended")
+        << (QStringList() << "Caf" << "Cafe" << "Cafe\u0301" << "Cafe\u0301 ok" << "Cafe ok");
+    QTest::newRow("combining mark inserted")
+        << (QStringList() << "resume sent" << "resume\u0301 sent" << "re\u0301sume\u0301 sent" << "resume sent");
+    QTest::newRow("compatibility characters")
+        << (QStringList() << "\uFB01ne" << "\uFB01ne \uFF21" << "\uFB01ne \uFF21\uFF22" << "\uFB01ne \uFF22" << "ne \uFF22");
+    QTest::newRow("conjoining jamo")
+        << (QStringList() << "\u1100" << "\u1100\u1161" << "\u1100\u1161\u11A8" << "\u1100\u11A8" << "x\u1100\u1161");
+    QTest::newRow("unchanged unnormalized text")
+        << (QStringList() << "\uFB01 x" << "\uFB01 x" << "\uFB01 xy");
+}
+
+void tst_SmsCharacterCounter::normalization()
+{
+    QFETCH(QStringList, texts);
+
+    SmsCharacterCounter editCounter;
+
+    foreach (const QString &text, texts) {
+        editCounter.setText(text);
+        QCOMPARE(editCounter.text(), text.normalized(QString::NormalizationForm_KC));
+
+        SmsCharacterCounter scratchCounter;
+        scratchCounter.setText(text);
+        QCOMPARE(editCounter.messageCount(), scratchCounter.messageCount());
+        QCOMPARE(editCounter.remainingCharacterCount(), scratchCounter.remainingCharacterCount());
+    }
+}
+
+void tst_SmsCharacterCounter::segmentBoundaries_data()
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QList<int> >("boundaries");
+    QTest::addColumn<int>("remaining");
+
+    QTest::newRow("single message")
+        << "default" << QString(160, 'a') << QList<int>() << 0;
+    QTest::newRow("concatenated")
+        << "default" << QString(307, 'a') << (QList<int>() << 153 << 306) << 152;
+    QTest::newRow("escape at segment end")
+        << "default" << QString(152, 'a') + "{" + QString(10, 'a') << (QList<int>() << 152) << 141;
+    QTest::newRow("escape after segment end")
+        << "default" << QString(153, 'a') + "{" + QString(10, 'a') << (QList<int>() << 153) << 141;
+    QTest::newRow("national language")
+        << "turkish" << QString(150, 'a') + QString(10, QChar(0x011F)) << (QList<int>() << 149) << 128;
+    QTest::newRow("national language escape at segment end")
+        << "spanish" << QString(148, 'a') + QString(10, QChar(0x00C1)) << (QList<int>() << 148) << 129;
+    QTest::newRow("UCS-2")
+        << "default" << QString(140, QChar(0x2022)) << (QList<int>() << 67 << 134) << 61;
+    QTest::newRow("surrogate pair at segment end")
+        << "default" << QString(66, QChar(0x2022)) + "\U0001F600" + QString(10, QChar(0x2022)) << (QList<int>() << 66) << 55;
+}
+
+void tst_SmsCharacterCounter::segmentBoundaries()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+    QFETCH(QList<int>, boundaries);
+    QFETCH(int, remaining);
+
+    SmsCharacterCounter segmentCounter;
+    segmentCounter.setAlphabet(alphabet);
+    segmentCounter.setText(text);
+    QCOMPARE(segmentCounter.segmentBoundaries(), boundaries);
+    QCOMPARE(segmentCounter.messageCount(), boundaries.count() + 1);
+    QCOMPARE(segmentCounter.remainingCharacterCount(), remaining);
+
+    // Typing the text must produce the same boundaries
+    SmsCharacterCounter typingCounter;
+    typingCounter.setAlphabet(alphabet);
+    for (int i = 1; i <= text.length(); ++i)
+        typingCounter.setText(text.left(i));
+    QCOMPARE(typingCounter.segmentBoundaries(), boundaries);
+    QCOMPARE(typingCounter.remainingCharacterCount(), remaining);
+
+    // The batch count must agree
+    const QVariantList counts(segmentCounter.countTexts(QStringList() << text));
+    QCOMPARE(counts.at(0).toMap().value("messageCount").toInt(), boundaries.count() + 1);
+    QCOMPARE(counts.at(0).toMap().value("remainingCharacterCount").toInt(), remaining);
+}
+
+void tst_SmsCharacterCounter::countTexts_data()
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<int>("textCount");
+
+    QTest::newRow("small batch") << "default" << int(SmsTextCounter::Default) << 5;
+    QTest::newRow("large batch") << "default" << int(SmsTextCounter::Default) << 500;
+    QTest::newRow("large national language batch") << "turkish" << int(SmsTextCounter::Turkish) << 500;
+}
+
+void tst_SmsCharacterCounter::countTexts()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(int, encoding);
+    QFETCH(int, textCount);
+
+    const QString fragments[] = {
+        QStringLiteral("Hello there"), QStringLiteral(" {braces}"), QStringLiteral(" \u011F\u015F"),
+        QStringLiteral(" \u2022"), QStringLiteral(" \uFB01ne"), QStringLiteral(" 0123456789012345678901234567890123456789")
+    };
+
+    QStringList texts;
+    for (int i = 0; i < textCount; ++i) {
+        QString text;
+        for (int j = 0; j <= i % 11; ++j)
+            text += fragments[(i + j * j) % 6];
+        texts.append(text);
+    }
+
+    const QVector<SmsTextCounter::TextCount> counts(SmsTextCounter::countTexts(texts, SmsTextCounter::Encoding(encoding)));
+    QCOMPARE(counts.count(), texts.count());
+
+    // Each text must produce the same result as counting it individually
+    for (int i = 0; i < texts.count(); ++i) {
+        SmsCharacterCounter scratchCounter;
+        scratchCounter.setAlphabet(alphabet);
+        scratchCounter.setText(texts.at(i));
+        QCOMPARE(counts.at(i).messageCount, scratchCounter.messageCount());
+        QCOMPARE(counts.at(i).remainingCharacterCount, scratchCounter.remainingCharacterCount());
+    }
+}
+
+void tst_SmsCharacterCounter::countTextsVariant()
+{
+    SmsCharacterCounter alphabetCounter;
+    alphabetCounter.setAlphabet(QStringLiteral("turkish"));
+
+    const QVariantList counts(alphabetCounter.countTexts(QStringList() << "Hello" << "\u011F\u015F" << "\u2022"));
+    QCOMPARE(counts.count(), 3);
+
+    QCOMPARE(counts.at(0).toMap().value("encoding").toString(), QString("default"));
+    QCOMPARE(counts.at(0).toMap().value("messageCount").toInt(), 1);
+    QCOMPARE(counts.at(0).toMap().value("remainingCharacterCount").toInt(), 155);
+    QCOMPARE(counts.at(1).toMap().value("encoding").toString(), QString("turkish"));
+    QCOMPARE(counts.at(1).toMap().value("remainingCharacterCount").toInt(), 151);
+    QCOMPARE(counts.at(2).toMap().value("encoding").toString(), QString("ucs2"));
+    QCOMPARE(counts.at(2).toMap().value("remainingCharacterCount").toInt(), 69);
+}
+
+void tst_SmsCharacterCounter::asynchronous()
+{
+    SmsCharacterCounter asyncCounter;
+    asyncCounter.setAsynchronousThreshold(100);
+
+    // Small edits are counted immediately
+    asyncCounter.setText("Hello");
+    QVERIFY(!asyncCounter.busy());
+    QCOMPARE(asyncCounter.remainingCharacterCount(), 155);
+
+    // Large edits are counted in the background, and the previous counts remain until then
+    const QString pasted(QString(1000, 'a'));
+    asyncCounter.setText(pasted);
+    QVERIFY(asyncCounter.busy());
+    QCOMPARE(asyncCounter.text(), QString("Hello"));
+    QCOMPARE(asyncCounter.messageCount(), 1);
+
+    QTRY_VERIFY(!asyncCounter.busy());
+    QCOMPARE(asyncCounter.text(), pasted);
+    QCOMPARE(asyncCounter.messageCount(), 7);
+    QCOMPARE(asyncCounter.remainingCharacterCount(), 71);
+
+    // A newer text supersedes a count in progress, which is then discarded
+    asyncCounter.setText(pasted + QString(500, QChar(0x2022)));
+    QVERIFY(asyncCounter.busy());
+    asyncCounter.setText(pasted + "!");
+    QVERIFY(!asyncCounter.busy());
+    QCOMPARE(asyncCounter.remainingCharacterCount(), 70);
+
+    QTest::qWait(50);
+    QCOMPARE(asyncCounter.text(), QString(pasted + "!"));
+    QCOMPARE(asyncCounter.remainingCharacterCount(), 70);
+
+    // Changing the alphabet during a count restarts it
+    const QString turkish(QString(200, QChar(0x011F)));
+    asyncCounter.setText(turkish);
+    QVERIFY(asyncCounter.busy());
+    asyncCounter.setAlphabet("turkish");
+    QTRY_VERIFY(!asyncCounter.busy());
+
+    SmsCharacterCounter scratchCounter;
+    scratchCounter.setAlphabet("turkish");
+    scratchCounter.setText(turkish);
+    QCOMPARE(asyncCounter.text(), turkish);
+    QCOMPARE(asyncCounter.messageCount(), scratchCounter.messageCount());
+    QCOMPARE(asyncCounter.remainingCharacterCount(), scratchCounter.remainingCharacterCount());
+    QCOMPARE(asyncCounter.segmentBoundaries(), scratchCounter.segmentBoundaries());
+}
+
+void tst_SmsCharacterCounter::unsupportedCharacters_data()
+{
+    QTest::addColumn<QString>("alphabet");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QList<int> >("positions");
+    QTest::addColumn<QStringList>("substitutes");
+    QTest::addColumn<int>("messageCount");
+    QTest::addColumn<int>("reducedMessageCount");
+
+    QTest::newRow("GSM text")
+        << "default" << "Hello {world}" << QList<int>() << QStringList() << 1 << 1;
+    QTest::newRow("typographic quotes")
+        << "default" << QString(100, 'a') + " \u201Cquoted\u201D" << (QList<int>() << 101 << 108) << (QStringList() << "\"" << "\"") << 2 << 1;
+    QTest::newRow("dashes and bullets")
+        << "default" << "\u2022 one \u2013 two" << (QList<int>() << 0 << 6) << (QStringList() << "*" << "-") << 1 << 1;
+    QTest::newRow("national characters")
+        << "default" << QString(150, 'a') + "\u011F\u015F" << (QList<int>() << 150 << 151) << (QStringList() << "g" << "s") << 3 << 1;
+    QTest::newRow("national characters with national alphabet")
+        << "turkish" << QString(155, 'a') + "\u011F\u015F" << QList<int>() << QStringList() << 2 << 2;
+    QTest::newRow("no substitute")
+        << "default" << "ok \U0001F600 \u2019" << (QList<int>() << 3 << 6) << (QStringList() << QString() << "'") << 1 << 1;
+}
+
+void tst_SmsCharacterCounter::unsupportedCharacters()
+{
+    QFETCH(QString, alphabet);
+    QFETCH(QString, text);
+    QFETCH(QList<int>, positions);
+    QFETCH(QStringList, substitutes);
+    QFETCH(int, messageCount);
+    QFETCH(int, reducedMessageCount);
+
+    SmsCharacterCounter unsupportedCounter;
+    unsupportedCounter.setAlphabet(alphabet);
+    unsupportedCounter.setText(text);
+    QCOMPARE(unsupportedCounter.messageCount(), messageCount);
+    QCOMPARE(unsupportedCounter.reducedMessageCount(), reducedMessageCount);
+
+    const QVariantList characters(unsupportedCounter.unsupportedCharacters());
+    QCOMPARE(characters.count(), positions.count());
+    for (int i = 0; i < characters.count(); ++i) {
+        const QVariantMap character(characters.at(i).toMap());
+        QCOMPARE(character.value("position").toInt(), positions.at(i));
+        QCOMPARE(character.value("substitute").toString(), substitutes.at(i));
+    }
+}
+
+void tst_SmsCharacterCounter::reduce()
+{
+    SmsCharacterCounter reduceCounter;
+    reduceCounter.setText(QString(100, 'a') + " \u201Cquoted\u201D");
+    QCOMPARE(reduceCounter.messageCount(), 2);
+
+    // Existing text is substituted when reduction is enabled
+    reduceCounter.setReduce(true);
+    QCOMPARE(reduceCounter.text(), QString(QString(100, 'a') + " \"quoted\""));
+    QCOMPARE(reduceCounter.messageCount(), 1);
+    QCOMPARE(reduceCounter.remainingCharacterCount(), 51);
+    QCOMPARE(reduceCounter.unsupportedCharacters().count(), 0);
+
+    // Later edits are substituted as they are made
+    reduceCounter.setText(QString(100, 'a') + " \u201Cquoted\u201D \u2026 it\u2019s");
+    QCOMPARE(reduceCounter.text(), QString(QString(100, 'a') + " \"quoted\" ... it's"));
+    QCOMPARE(reduceCounter.messageCount(), 1);
+
+    // Characters without substitutes remain
+    reduceCounter.setText("ok \U0001F600");
+    QCOMPARE(reduceCounter.text(), QString("ok \U0001F600"));
+    QCOMPARE(reduceCounter.unsupportedCharacters().count(), 1);
+
+    // Disabling reduction restores the text as supplied, and its counts
+    const QString quoted(QString(100, 'a') + " \u201Cquoted\u201D");
+    reduceCounter.setText(quoted);
+    QCOMPARE(reduceCounter.messageCount(), 1);
+    reduceCounter.setReduce(false);
+    QCOMPARE(reduceCounter.text(), quoted);
+    QCOMPARE(reduceCounter.messageCount(), 2);
+    QCOMPARE(reduceCounter.remainingCharacterCount(), SmsTextCounter::countText(quoted, SmsTextCounter::Default).remainingCharacterCount);
+    QCOMPARE(reduceCounter.unsupportedCharacters().count(), 2);
+
+    // Substitutions are made again when the alphabet changes
+    const QString turkish(QString(150, 'a') + "\u011F\u015F");
+    SmsCharacterCounter alphabetCounter;
+    alphabetCounter.setReduce(true);
+    alphabetCounter.setText(turkish);
+    QCOMPARE(alphabetCounter.text(), QString(QString(150, 'a') + "gs"));
+
+    alphabetCounter.setAlphabet("turkish");
+    QCOMPARE(alphabetCounter.text(), turkish);
+    QCOMPARE(alphabetCounter.messageCount(), SmsTextCounter::countText(turkish, SmsTextCounter::Turkish).messageCount);
+    QCOMPARE(alphabetCounter.unsupportedCharacters().count(), 0);
+
+    alphabetCounter.setAlphabet("default");
+    QCOMPARE(alphabetCounter.text(), QString(QString(150, 'a') + "gs"));
+    QCOMPARE(alphabetCounter.messageCount(), 1);
+}
+
+void tst_SmsCharacterCounter::cache()
+{
+    SmsCharacterCounter::clearCache();
+
+    const QString draft(QString(150, 'a') + "{\uFB01}");
+    SmsCharacterCounter first;
+    first.setText(draft);
+    QCOMPARE(SmsCharacterCounter::cacheMissCount(), 1);
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), 0);
+
+    // Another counter replacing its text with the same draft reuses the result
+    SmsCharacterCounter second;
+    second.setText("Something else");
+    second.setText(draft);
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), 1);
+    QCOMPARE(second.text(), first.text());
+    QCOMPARE(second.messageCount(), first.messageCount());
+    QCOMPARE(second.remainingCharacterCount(), first.remainingCharacterCount());
+    QCOMPARE(second.segmentBoundaries(), first.segmentBoundaries());
+
+    // Edits to the cached text continue incrementally
+    second.setText(draft + "b");
+    first.setText(draft + "b");
+    QCOMPARE(second.remainingCharacterCount(), first.remainingCharacterCount());
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), 1);
+
+    // Results are not shared between counters with different settings
+    SmsCharacterCounter third;
+    third.setAlphabet("turkish");
+    third.setText(draft);
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), 1);
+    QCOMPARE(third.remainingCharacterCount(), SmsTextCounter::countText(draft, SmsTextCounter::Turkish).remainingCharacterCount);
+
+    // Typing next to a character that normalization may combine is not a replacement, although
+    // the span counted again covers the whole text
+    SmsCharacterCounter fourth;
+    fourth.setText("\u00E9");
+    const int missCount = SmsCharacterCounter::cacheMissCount();
+    fourth.setText("\u00E9a");
+    fourth.applyEdit(0, 0, "b");
+    QCOMPARE(SmsCharacterCounter::cacheMissCount(), missCount);
+    QCOMPARE(fourth.text(), QString("b\u00E9a"));
+
+    // Replacing the whole text through an edit is
+    fourth.applyEdit(0, 3, draft);
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), 2);
+    QCOMPARE(fourth.remainingCharacterCount(), first.remainingCharacterCount() + 1);
+
+    // Counts made in the background are cached only where they replaced the text entirely
+    SmsCharacterCounter asyncCounter;
+    asyncCounter.setAsynchronousThreshold(100);
+    asyncCounter.setText("Hello");
+    asyncCounter.applyEdit(5, 0, QString(500, 'c'));
+    QTRY_VERIFY(!asyncCounter.busy());
+    const QString pasted(QString(500, 'd'));
+    asyncCounter.setText(pasted);
+    QTRY_VERIFY(!asyncCounter.busy());
+
+    const int hitCount = SmsCharacterCounter::cacheHitCount();
+    SmsCharacterCounter fifth;
+    fifth.setText(QString("Hello") + QString(500, 'c'));
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), hitCount);
+    fifth.setText(pasted);
+    QCOMPARE(SmsCharacterCounter::cacheHitCount(), hitCount + 1);
+    QCOMPARE(fifth.remainingCharacterCount(), asyncCounter.remainingCharacterCount());
+    QCOMPARE(fifth.segmentBoundaries(), asyncCounter.segmentBoundaries());
+}
+
+void tst_SmsCharacterCounter::applyEdit_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("position");
+    QTest::addColumn<int>("removedLength");
+    QTest::addColumn<QString>("inserted");
+    QTest::addColumn<QString>("result");
+
+    QTest::newRow("append") << "Hello" << 5 << 0 << " there" << "Hello there";
+    QTest::newRow("prepend") << "there" << 0 << 0 << "Hi " << "Hi there";
+    QTest::newRow("delete") << "Hello there" << 5 << 6 << QString() << "Hello";
+    QTest::newRow("replace all") << "Hello" << 0 << 5 << "Bye" << "Bye";
+    QTest::newRow("unicode insert") << "Hello there" << 5 << 0 << " \u2022" << "Hello \u2022 there";
+    QTest::newRow("combining mark") << "Hello there" << 9 << 0 << "\u0301" << "Hello th\u00E9re";
+    QTest::newRow("after ligature") << "\uFB01ne" << 1 << 0 << "x" << "fixne";
+    QTest::newRow("within ligature text") << "a\uFB01 b" << 3 << 1 << "c" << "afi c";
+}
+
+void tst_SmsCharacterCounter::applyEdit()
+{
+    QFETCH(QString, text);
+    QFETCH(int, position);
+    QFETCH(int, removedLength);
+    QFETCH(QString, inserted);
+    QFETCH(QString, result);
+
+    // Positions refer to the text as supplied, even where our normalized text differs
+    SmsCharacterCounter editCounter;
+    editCounter.setText(text);
+    editCounter.applyEdit(position, removedLength, inserted);
+    QCOMPARE(editCounter.text(), result);
+
+    SmsCharacterCounter scratchCounter;
+    scratchCounter.setText(QString(text).replace(position, removedLength, inserted));
+    QCOMPARE(editCounter.messageCount(), scratchCounter.messageCount());
+    QCOMPARE(editCounter.remainingCharacterCount(), scratchCounter.remainingCharacterCount());
+    QCOMPARE(editCounter.segmentBoundaries(), scratchCounter.segmentBoundaries());
+
+    // Edits outside the text are ignored
+    editCounter.applyEdit(result.length() + 10, 1, "x");
+    QCOMPARE(editCounter.text(), result);
+}
+
+void tst_SmsCharacterCounter::encodingCandidates()
+{
+    SmsCharacterCounter candidateCounter;
+    QCOMPARE(candidateCounter.encodingCandidates().count(), 2);
+
+    // Every candidate is measured, whichever is used
+    candidateCounter.setAlphabet(QStringLiteral("turkish"));
+    candidateCounter.setText(QStringLiteral("Hello \u011F{}"));
+
+    const QVariantList candidates(candidateCounter.encodingCandidates());
+    QCOMPARE(candidates.count(), 4);
+    QCOMPARE(candidates.at(0).toMap().value("encoding").toString(), QString("default"));
+    QCOMPARE(candidates.at(0).toMap().value("viable").toBool(), false);
+    QCOMPARE(candidates.at(0).toMap().value("characterCount").toInt(), -1);
+    QCOMPARE(candidates.at(1).toMap().value("encoding").toString(), QString("turkish"));
+    QCOMPARE(candidates.at(1).toMap().value("lockingShift").toBool(), false);
+    QCOMPARE(candidates.at(1).toMap().value("viable").toBool(), true);
+    QCOMPARE(candidates.at(1).toMap().value("characterCount").toInt(), 12);
+    QCOMPARE(candidates.at(2).toMap().value("lockingShift").toBool(), true);
+    QCOMPARE(candidates.at(2).toMap().value("characterCount").toInt(), 11);
+    QCOMPARE(candidates.at(3).toMap().value("encoding").toString(), QString("ucs2"));
+    QCOMPARE(candidates.at(3).toMap().value("characterCount").toInt(), 9);
+
+    // The first viable candidate is used
+    QCOMPARE(candidateCounter.remainingCharacterCount(), 155 - 12);
+
+    // Characters outside the GSM tables leave only UCS-2
+    candidateCounter.setText(QStringLiteral("Hello \u2022"));
+    QCOMPARE(candidateCounter.encodingCandidates().at(1).toMap().value("viable").toBool(), false);
+    QCOMPARE(candidateCounter.encodingCandidates().at(2).toMap().value("viable").toBool(), false);
+    QCOMPARE(candidateCounter.encodingCandidates().at(3).toMap().value("viable").toBool(), true);
+    QCOMPARE(candidateCounter.remainingCharacterCount(), 70 - 7);
+}
+
+void tst_SmsCharacterCounter::truncatedLength_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("segmentCount");
+    QTest::addColumn<int>("length");
+
+    QTest::newRow("fits") << QString(200, 'a') << 2 << 200;
+    QTest::newRow("single") << QString(200, 'a') << 1 << 160;
+    QTest::newRow("concatenated") << QString(400, 'a') << 2 << 306;
+    QTest::newRow("none") << QString(400, 'a') << 0 << 0;
+    QTest::newRow("escape single") << QString(QString(152, 'a') + "{" + QString(200, 'a')) << 1 << 159;
+    QTest::newRow("escape concatenated") << QString(QString(152, 'a') + "{" + QString(200, 'a')) << 2 << 304;
+    QTest::newRow("encoding change single") << QString(QString(100, 'a') + "\u2022" + QString(100, 'a')) << 1 << 100;
+    QTest::newRow("encoding change concatenated") << QString(QString(100, 'a') + "\u2022" + QString(100, 'a')) << 2 << 134;
+    QTest::newRow("surrogate pair") << QString(QString(69, QChar(0x4E00)) + "\U0001F600" + QString(10, QChar(0x4E00))) << 1 << 69;
+}
+
+void tst_SmsCharacterCounter::truncatedLength()
+{
+    QFETCH(QString, text);
+    QFETCH(int, segmentCount);
+    QFETCH(int, length);
+
+    counter.setText(text);
+    QCOMPARE(counter.truncatedLength(segmentCount), length);
+
+    // The prefix must fit, and the prefix one character longer must not
+    SmsCharacterCounter prefixCounter;
+    prefixCounter.setText(text.left(length));
+    QVERIFY(prefixCounter.messageCount() <= segmentCount);
+    if (length < text.length()) {
+        prefixCounter.setText(text.left(length + (text.at(length).isHighSurrogate() ? 2 : 1)));
+        QVERIFY(prefixCounter.messageCount() > segmentCount);
+    }
+}
+
+void tst_SmsCharacterCounter::remainingCharacterCountWithin()
+{
+    SmsCharacterCounter remainingCounter;
+    remainingCounter.setText(QString(10, 'a'));
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(1), 150);
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(2), 296);
+
+    remainingCounter.setText(QString(200, 'a'));
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(1), -40);
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(2), 106);
+
+    // Escapes are not separated from their characters
+    remainingCounter.setText(QString(152, 'a') + "{" + QString(200, 'a'));
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(3), 153 * 3 - 354 - 1);
+    QCOMPARE(remainingCounter.remainingCharacterCountWithin(2), -(354 - 152 - 153));
+}
+
 #include "tst_smscharactercounter.moc"
-QTEST_APPLESS_MAIN(tst_SmsCharacterCounter)
+QTEST_GUILESS_MAIN(tst_SmsCharacterCounter)
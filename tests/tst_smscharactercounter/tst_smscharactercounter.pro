@@ -1,7 +1,12 @@
 include(../common.pri)
 TARGET = tst_smscharactercounter
 
+QT += concurrent quick
+
 SOURCES += tst_smscharactercounter.cpp
 
-SOURCES += ../../src/smscharactercounter.cpp
-HEADERS += ../../src/smscharactercounter.h
+SOURCES += ../../src/smscharactercounter.cpp \
+    ../../src/smstextcounter.cpp
+HEADERS += ../../src/smscharactercounter.h \
+    ../../src/smstextcounter.h \
+    ../../src/smsalphabet.h
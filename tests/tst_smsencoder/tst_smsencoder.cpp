@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2015 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QtTest>
+
+#include "smsencoder.h"
+
+
+class tst_SmsEncoder : public QObject
+{
+    Q_OBJECT
+
+public:
+    tst_SmsEncoder();
+
+private slots:
+    void packSeptets_data();
+    void packSeptets();
+    void packSeptetsOffset();
+    void encode_data();
+    void encode();
+    void concatenated();
+    void splits();
+    void nationalLanguage();
+    void consistency_data();
+    void consistency();
+};
+
+
+tst_SmsEncoder::tst_SmsEncoder()
+{
+}
+
+void tst_SmsEncoder::packSeptets_data()
+{
+    QTest::addColumn<QByteArray>("septets");
+    QTest::addColumn<QByteArray>("packed");
+
+    QTest::newRow("empty") << QByteArray() << QByteArray();
+    QTest::newRow("short") << QByteArray("hello") << QByteArray::fromHex("e8329bfd06");
+    QTest::newRow("eight") << QByteArray("hellohel") << QByteArray::fromHex("e8329bfd4697d9");
+    QTest::newRow("nine") << QByteArray("hellohell") << QByteArray::fromHex("e8329bfd4697d96c");
+    QTest::newRow("ten") << QByteArray("hellohello") << QByteArray::fromHex("e8329bfd4697d9ec37");
+}
+
+void tst_SmsEncoder::packSeptets()
+{
+    QFETCH(QByteArray, septets);
+    QFETCH(QByteArray, packed);
+
+    QByteArray output((septets.length() * 7 + 7) / 8, '\0');
+    SmsEncoder::packSeptets(septets.constData(), septets.length(), 0, output.data());
+    QCOMPARE(output.toHex(), packed.toHex());
+}
+
+void tst_SmsEncoder::packSeptetsOffset()
+{
+    // Compare with bitwise packing, for lengths crossing the eight septet blocks at every offset
+    for (int offset = 0; offset < 70; offset += 7) {
+        for (int count = 0; count < 40; ++count) {
+            QByteArray septets;
+            for (int i = 0; i < count; ++i)
+                septets.append(char((i * 37 + offset) & 0x7F));
+
+            QByteArray expected((offset + count * 7 + 7) / 8, '\0');
+            for (int i = 0; i < count * 7; ++i) {
+                if (septets.at(i / 7) & (1 << (i % 7)))
+                    expected[(offset + i) / 8] = char(expected.at((offset + i) / 8) | (1 << ((offset + i) % 8)));
+            }
+
+            QByteArray output(expected.length(), '\0');
+            SmsEncoder::packSeptets(septets.constData(), count, offset, output.data());
+            QCOMPARE(output.toHex(), expected.toHex());
+        }
+    }
+}
+
+void tst_SmsEncoder::encode_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<int>("encoding");
+    QTest::addColumn<int>("userDataLength");
+    QTest::addColumn<QByteArray>("userData");
+
+    QTest::newRow("empty") << QString() << int(SmsTextCounter::Default) << 0 << QByteArray();
+    QTest::newRow("basic") << QString("hello") << int(SmsTextCounter::Default) << 5 << QByteArray::fromHex("e8329bfd06");
+    QTest::newRow("escaped") << QStringLiteral("\u20AC") << int(SmsTextCounter::Default) << 2 << QByteArray::fromHex("9b32");
+    QTest::newRow("normalized") << QStringLiteral("\uFB01") << int(SmsTextCounter::Default) << 2 << QByteArray::fromHex("e634");
+    QTest::newRow("ucs2") << QStringLiteral("a\u2022") << int(SmsTextCounter::UCS2) << 4 << QByteArray::fromHex("00612022");
+}
+
+void tst_SmsEncoder::encode()
+{
+    QFETCH(QString, text);
+    QFETCH(int, encoding);
+    QFETCH(int, userDataLength);
+    QFETCH(QByteArray, userData);
+
+    const SmsEncoder::Message message(SmsEncoder::encode(text, SmsTextCounter::Default));
+    QCOMPARE(int(message.baseEncoding), encoding);
+    QCOMPARE(message.segments.count(), text.isEmpty() ? 0 : 1);
+    if (!text.isEmpty()) {
+        QCOMPARE(message.segments.at(0).userDataLength, userDataLength);
+        QCOMPARE(message.segments.at(0).userData.toHex(), userData.toHex());
+    }
+}
+
+void tst_SmsEncoder::concatenated()
+{
+    const SmsEncoder::Message message(SmsEncoder::encode(QString(161, QChar('a')), SmsTextCounter::Default, 0x42));
+    QCOMPARE(message.segments.count(), 2);
+
+    // Each segment has a concatenation header, followed by a fill bit before the septets
+    const SmsEncoder::Segment &first(message.segments.at(0));
+    QCOMPARE(first.userDataLength, 160);
+    QCOMPARE(first.userData.length(), 140);
+    QCOMPARE(first.userData.left(6).toHex(), QByteArray("050003420201"));
+    QCOMPARE(int(uchar(first.userData.at(6))), 0xC2);
+
+    const SmsEncoder::Segment &second(message.segments.at(1));
+    QCOMPARE(second.userDataLength, 15);
+    QCOMPARE(second.userData.length(), 14);
+    QCOMPARE(second.userData.left(6).toHex(), QByteArray("050003420202"));
+    QCOMPARE(int(uchar(second.userData.at(6))), 0xC2);
+}
+
+void tst_SmsEncoder::splits()
+{
+    // An escaped character is moved to the next segment rather than being split
+    const SmsEncoder::Message escaped(SmsEncoder::encode(QString(152, QChar('a')) + "{" + QString(10, QChar('a')), SmsTextCounter::Default));
+    QCOMPARE(escaped.segments.count(), 2);
+    QCOMPARE(escaped.segments.at(0).userDataLength, 7 + 152);
+    QCOMPARE(escaped.segments.at(1).userDataLength, 7 + 12);
+
+    // A surrogate pair is likewise kept together
+    const SmsEncoder::Message surrogate(SmsEncoder::encode(QString(66, QChar(0x4E00)) + "\U0001F600" + QString(5, QChar(0x4E00)), SmsTextCounter::Default));
+    QCOMPARE(int(surrogate.baseEncoding), int(SmsTextCounter::UCS2));
+    QCOMPARE(surrogate.segments.count(), 2);
+    QCOMPARE(surrogate.segments.at(0).userDataLength, 6 + 66 * 2);
+    QCOMPARE(surrogate.segments.at(0).userData.right(2).toHex(), QByteArray("4e00"));
+    QCOMPARE(surrogate.segments.at(1).userData.mid(6, 4).toHex(), QByteArray("d83dde00"));
+}
+
+void tst_SmsEncoder::nationalLanguage()
+{
+    // The single shift table is identified in the header, which the septets follow after fill bits
+    const SmsEncoder::Message message(SmsEncoder::encode(QStringLiteral("\u011F"), SmsTextCounter::Turkish));
+    QCOMPARE(int(message.baseEncoding), int(SmsTextCounter::Default));
+    QCOMPARE(int(message.shiftEncoding), int(SmsTextCounter::Turkish));
+    QCOMPARE(message.segments.count(), 1);
+    QCOMPARE(message.segments.at(0).userDataLength, 5 + 2);
+    QCOMPARE(message.segments.at(0).userData.toHex(), QByteArray("03240101" "d89c01"));
+}
+
+void tst_SmsEncoder::consistency_data()
+{
+    QTest::addColumn<int>("encoding");
+
+    QTest::newRow("default") << int(SmsTextCounter::Default);
+    QTest::newRow("turkish") << int(SmsTextCounter::Turkish);
+    QTest::newRow("spanish") << int(SmsTextCounter::Spanish);
+    QTest::newRow("portuguese") << int(SmsTextCounter::Portuguese);
+}
+
+void tst_SmsEncoder::consistency()
+{
+    QFETCH(int, encoding);
+
+    const QString fragments[] = {
+        QStringLiteral("Hello there"), QStringLiteral(" {braces}"), QStringLiteral(" \u011F\u015F"),
+        QStringLiteral(" \u00E1\u00EA"), QStringLiteral(" \uFB01ne"), QStringLiteral(" 0123456789012345678901234567890123456789"),
+        QStringLiteral(" \u2022"), QStringLiteral("\U0001F600")
+    };
+
+    // The encoded segments must match the count reported by the character counter
+    for (int i = 0; i < 200; ++i) {
+        QString text;
+        for (int j = 0; j <= i % 23; ++j)
+            text += fragments[(i + j * j) % (i % 3 ? 6 : 8)];
+
+        SmsTextCounter counter(static_cast<SmsTextCounter::Encoding>(encoding));
+        counter.setText(text);
+
+        const SmsEncoder::Message message(SmsEncoder::encode(text, counter.alphabet()));
+        QCOMPARE(message.segments.count(), counter.messageCount());
+        QCOMPARE(message.segments.count(), counter.segmentBoundaries().count() + 1);
+
+        foreach (const SmsEncoder::Segment &segment, message.segments) {
+            QVERIFY(segment.userData.length() <= 140);
+            if (message.baseEncoding == SmsTextCounter::UCS2)
+                QCOMPARE(segment.userDataLength, segment.userData.length());
+            else
+                QCOMPARE(segment.userData.length(), (segment.userDataLength * 7 + 7) / 8);
+        }
+    }
+}
+
+#include "tst_smsencoder.moc"
+QTEST_GUILESS_MAIN(tst_SmsEncoder)
@@ -0,0 +1,12 @@
+include(../common.pri)
+TARGET = tst_smsencoder
+
+QT += concurrent
+
+SOURCES += tst_smsencoder.cpp
+
+SOURCES += ../../src/smsencoder.cpp \
+    ../../src/smstextcounter.cpp
+HEADERS += ../../src/smsencoder.h \
+    ../../src/smsalphabet.h \
+    ../../src/smstextcounter.h
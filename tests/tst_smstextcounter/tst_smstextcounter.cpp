@@ -0,0 +1,307 @@
+/*
+ * Copyright (C) 2015 Jolla Ltd.
+ *
+ * You may use this file under the terms of the BSD license as follows:
+ *
+ * "Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are
+ * met:
+ *   * Redistributions of source code must retain the above copyright
+ *     notice, this list of conditions and the following disclaimer.
+ *   * Redistributions in binary form must reproduce the above copyright
+ *     notice, this list of conditions and the following disclaimer in
+ *     the documentation and/or other materials provided with the
+ *     distribution.
+ *   * Neither the name of Nemo Mobile nor the names of its contributors
+ *     may be used to endorse or promote products derived from this
+ *     software without specific prior written permission.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE."
+ */
+
+#include <QObject>
+#include <QtConcurrent>
+#include <QtTest>
+
+#include "smstextcounter.h"
+
+namespace {
+
+// Characters exercising each table, escapes, normalization, substitution and surrogate pairs
+const ushort interestingCharacters[] = {
+    ' ', '\n', '{', '`', 0x00A0, 0x00C7, 0x00E1, 0x00E3, 0x00E7, 0x00E8, 0x011F, 0x0131,
+    0x0301, 0x0327, 0x1100, 0x1161, 0x11A8, 0x20AC, 0x2022, 0x2126, 0x212B, 0x221E,
+    0x4E00, 0xD83D, 0xDE00, 0xFB01, 0xFF21
+};
+
+// A deterministic generator, so that any failure can be reproduced from its seed
+class Generator
+{
+public:
+    explicit Generator(uint seed) : m_state(seed) {}
+
+    int bounded(int limit)
+    {
+        m_state = m_state * 1103515245u + 12345u;
+        return limit > 0 ? int((m_state >> 8) % uint(limit)) : 0;
+    }
+
+    QChar character()
+    {
+        if (bounded(3))
+            return QChar('a' + bounded(26));
+        return QChar(interestingCharacters[bounded(sizeof(interestingCharacters) / sizeof(interestingCharacters[0]))]);
+    }
+
+    QString characters(int count)
+    {
+        QString result;
+        for (int i = 0; i < count; ++i)
+            result.append(character());
+        return result;
+    }
+
+private:
+    uint m_state;
+};
+
+}
+
+class tst_SmsTextCounter : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void emptyText();
+    void sourceText();
+    void differential_data();
+    void differential();
+    void concurrentCounters();
+    void cancellation();
+
+private:
+    static void compareCounters(const SmsTextCounter &counter, const SmsTextCounter &scratch);
+};
+
+void tst_SmsTextCounter::compareCounters(const SmsTextCounter &counter, const SmsTextCounter &scratch)
+{
+    QCOMPARE(counter.text(), scratch.text());
+    QCOMPARE(int(counter.baseEncoding()), int(scratch.baseEncoding()));
+    QCOMPARE(int(counter.shiftEncoding()), int(scratch.shiftEncoding()));
+    QCOMPARE(counter.characterCount(), scratch.characterCount());
+    QCOMPARE(counter.messageCount(), scratch.messageCount());
+    QCOMPARE(counter.remainingCharacterCount(), scratch.remainingCharacterCount());
+    QCOMPARE(counter.segmentBoundaries(), scratch.segmentBoundaries());
+    QCOMPARE(counter.unsupportedCount(), scratch.unsupportedCount());
+    QVERIFY(counter.encodingCandidates() == scratch.encodingCandidates());
+}
+
+void tst_SmsTextCounter::emptyText()
+{
+    SmsTextCounter counter(SmsTextCounter::Turkish);
+    QCOMPARE(counter.messageCount(), 0);
+    QCOMPARE(counter.remainingCharacterCount(), 0);
+    QCOMPARE(counter.encodingCandidates().count(), 4);
+
+    QVERIFY(counter.setText(QStringLiteral("abc")));
+    QVERIFY(counter.setText(QString()));
+    compareCounters(counter, SmsTextCounter(SmsTextCounter::Turkish));
+}
+
+void tst_SmsTextCounter::sourceText()
+{
+    SmsTextCounter counter;
+
+    // Edits refer to the text as supplied, rather than as normalized
+    QVERIFY(counter.setText(QStringLiteral("e\u0301 x")));
+    QCOMPARE(counter.text(), QStringLiteral("\u00E9 x"));
+    QCOMPARE(counter.sourceText(), QStringLiteral("e\u0301 x"));
+
+    QVERIFY(counter.applyEdit(3, 1, QStringLiteral("y")));
+    QCOMPARE(counter.text(), QStringLiteral("\u00E9 y"));
+    QCOMPARE(counter.sourceText(), QStringLiteral("e\u0301 y"));
+
+    // An edit may be inspected before it is applied
+    const SmsTextCounter::Edit edit(counter.textEdit(QStringLiteral("e\u0301 yz")));
+    QVERIFY(!edit.replacesText);
+    QCOMPARE(counter.editedText(edit), QStringLiteral("e\u0301 yz"));
+    QVERIFY(counter.applyEdit(edit));
+    QCOMPARE(counter.text(), QStringLiteral("\u00E9 yz"));
+    QCOMPARE(counter.sourceText(), QStringLiteral("e\u0301 yz"));
+
+    // Edits elsewhere leave the differing span as supplied
+    QVERIFY(counter.applyEdit(4, 0, QStringLiteral("\uFB01")));
+    QCOMPARE(counter.text(), QStringLiteral("\u00E9 yfiz"));
+    QCOMPARE(counter.sourceText(), QStringLiteral("e\u0301 y\uFB01z"));
+    QVERIFY(counter.applyEdit(4, 1, QString()));
+    QCOMPARE(counter.sourceText(), QStringLiteral("e\u0301 yz"));
+
+    // Replacing the text as supplied with its normalized form doesn't modify the counted text
+    QVERIFY(counter.textEdit(QStringLiteral("other")).replacesText);
+    QVERIFY(!counter.setText(QStringLiteral("\u00E9 yz")));
+    QCOMPARE(counter.sourceText(), QStringLiteral("\u00E9 yz"));
+}
+
+void tst_SmsTextCounter::differential_data()
+{
+    QTest::addColumn<int>("alphabet");
+    QTest::addColumn<bool>("reduce");
+    QTest::addColumn<uint>("seed");
+
+    const char *names[] = { "default", "spanish", "portuguese", "turkish" };
+    const char *reducedNames[] = { "default reduced", "spanish reduced", "portuguese reduced", "turkish reduced" };
+    for (int alphabet = SmsTextCounter::Default; alphabet <= SmsTextCounter::Turkish; ++alphabet) {
+        QTest::newRow(names[alphabet]) << alphabet << false << uint(alphabet + 1);
+        QTest::newRow(reducedNames[alphabet]) << alphabet << true << uint(alphabet + 11);
+    }
+}
+
+void tst_SmsTextCounter::differential()
+{
+    QFETCH(int, alphabet);
+    QFETCH(bool, reduce);
+    QFETCH(uint, seed);
+
+    Generator generator(seed);
+
+    // Every incremental path must leave the counter exactly as counting its text from scratch would
+    for (int round = 0; round < 20; ++round) {
+        SmsTextCounter::Encoding encoding = SmsTextCounter::Encoding(alphabet);
+        SmsTextCounter counter(encoding);
+        QString text;
+
+        for (int step = 0; step < 150; ++step) {
+            const int operation = generator.bounded(8);
+            int position = generator.bounded(text.length() + 1);
+            int removedLength = 0;
+            QString inserted;
+
+            if (operation == 0 || text.isEmpty()) {
+                // Typing or pasting
+                inserted = generator.characters(1 + (generator.bounded(4) ? generator.bounded(3) : generator.bounded(200)));
+            } else if (operation == 1) {
+                // Deleting a selection
+                removedLength = generator.bounded(text.length() - position + 1);
+            } else if (operation == 2) {
+                // Backspacing at the end
+                removedLength = qMin(text.length(), 1 + generator.bounded(3));
+                position = text.length() - removedLength;
+            } else if (operation == 3) {
+                // Appending
+                position = text.length();
+                inserted = QString(generator.character());
+            } else if (operation == 4) {
+                // Replacing a selection
+                removedLength = generator.bounded(text.length() - position + 1);
+                inserted = generator.characters(1 + generator.bounded(3));
+            } else if (operation == 5) {
+                // The alphabet may change while a text is being edited, even once substituted
+                encoding = SmsTextCounter::Encoding(generator.bounded(SmsTextCounter::Turkish + 1));
+                counter.setAlphabet(encoding);
+            } else if (operation == 6 && reduce) {
+                // Reduction may be enabled and disabled again
+                counter.setReduce(!counter.reduce());
+            } else {
+                inserted = QString(generator.character());
+            }
+
+            text.replace(position, removedLength, inserted);
+            if (generator.bounded(20)) {
+                counter.applyEdit(position, removedLength, inserted);
+            } else {
+                counter.setText(text);
+            }
+            QCOMPARE(counter.sourceText(), text);
+
+            SmsTextCounter scratch(encoding, counter.reduce());
+            scratch.setText(text);
+            compareCounters(counter, scratch);
+            if (QTest::currentTestFailed()) {
+                qWarning() << "Mismatch at round" << round << "step" << step;
+                return;
+            }
+
+            if (step % 10 == 0) {
+                for (int segmentCount = 1; segmentCount <= 3; ++segmentCount) {
+                    QCOMPARE(counter.truncatedLength(segmentCount), scratch.truncatedLength(segmentCount));
+                    QCOMPARE(counter.remainingCharacterCountWithin(segmentCount), scratch.remainingCharacterCountWithin(segmentCount));
+                }
+                QCOMPARE(counter.reducedMessageCount(), scratch.reducedMessageCount());
+            }
+
+            if (!counter.reduce()) {
+                const SmsTextCounter::TextCount count(SmsTextCounter::countText(text, encoding));
+                QCOMPARE(count.messageCount, counter.messageCount());
+                QCOMPARE(count.remainingCharacterCount, counter.remainingCharacterCount());
+            }
+
+            if (text.length() > 2000) {
+                text.clear();
+                counter.setText(text);
+            }
+        }
+    }
+}
+
+void tst_SmsTextCounter::concurrentCounters()
+{
+    Generator generator(42);
+    QStringList texts;
+    for (int i = 0; i < 64; ++i)
+        texts.append(generator.characters(generator.bounded(500)));
+
+    // Counters share no state, so they can be edited in different threads at once
+    QVector<int> indices;
+    for (int i = 0; i < texts.count(); ++i)
+        indices.append(i);
+
+    QVector<int> counts(texts.count());
+    int *data = counts.data();
+    QtConcurrent::blockingMap(indices, [&texts, data](int index) {
+        const QString &text(texts.at(index));
+        SmsTextCounter counter(SmsTextCounter::Portuguese);
+        for (int i = 0; i < text.length(); ++i)
+            counter.applyEdit(i, 0, text.mid(i, 1));
+        data[index] = counter.messageCount();
+    });
+
+    for (int i = 0; i < texts.count(); ++i)
+        QCOMPARE(counts.at(i), SmsTextCounter::countText(texts.at(i), SmsTextCounter::Portuguese).messageCount);
+}
+
+void tst_SmsTextCounter::cancellation()
+{
+    Generator generator(7);
+    const QString text(generator.characters(200000));
+
+    // An unset flag does not affect counting
+    QAtomicInt cancelled(0);
+    SmsTextCounter counter(SmsTextCounter::Spanish);
+    counter.setCancellation(&cancelled);
+    counter.setText(text);
+
+    SmsTextCounter scratch(SmsTextCounter::Spanish);
+    scratch.setText(text);
+    compareCounters(counter, scratch);
+
+    // Once the flag is set, counting is abandoned before the text has been examined
+    cancelled.storeRelease(1);
+    SmsTextCounter abandoned(SmsTextCounter::Spanish);
+    abandoned.setCancellation(&cancelled);
+    abandoned.setText(text);
+    QVERIFY(abandoned.characterCount() < scratch.characterCount());
+    QVERIFY(abandoned.segmentBoundaries().count() < scratch.segmentBoundaries().count());
+}
+
+#include "tst_smstextcounter.moc"
+QTEST_GUILESS_MAIN(tst_SmsTextCounter)
@@ -0,0 +1,10 @@
+include(../common.pri)
+TARGET = tst_smstextcounter
+
+QT += concurrent
+
+SOURCES += tst_smstextcounter.cpp
+
+SOURCES += ../../src/smstextcounter.cpp
+HEADERS += ../../src/smstextcounter.h \
+    ../../src/smsalphabet.h